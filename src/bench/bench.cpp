@@ -0,0 +1,273 @@
+#include "../headers/EasyVulkan.hpp"
+#include "../headers/PipelineRegistry.hpp"
+
+using namespace Vulkan;
+
+// Microbenchmarks of the wrappers on the headless path, e.g. with lavapipe as the ICD.
+// Usage: VulkanLearnBench [--out bench.json] [--iterations-scale 1.0] [--pooled-host-allocator]
+// Results are written as JSON, times in microseconds. With --pooled-host-allocator, host memory per allocation scope too.
+
+struct BenchResult {
+    std::string name;
+    std::vector<double> samples;
+    // Optional derived figure, e.g. submits per second.
+    const char* rateUnit = nullptr;
+    double rate = 0;
+};
+
+// A deque, so that references returned by addResult() stay valid.
+std::deque<BenchResult> benchResults;
+double iterationsScale = 1;
+bool pooledHostAllocator = false;
+
+uint32_t iterations(uint32_t count) {
+    return std::max(1u, uint32_t(count * iterationsScale));
+}
+
+double microsecondsSince(std::chrono::steady_clock::time_point time) {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - time).count();
+}
+
+BenchResult& addResult(const char* name) {
+    return benchResults.emplace_back(BenchResult{ name });
+}
+
+template<typename Function>
+BenchResult& measure(const char* name, uint32_t count, Function&& function) {
+    BenchResult& benchResult = addResult(name);
+    benchResult.samples.reserve(count);
+    for (uint32_t i = 0; i < count; i++) {
+        auto time = std::chrono::steady_clock::now();
+        function();
+        benchResult.samples.push_back(microsecondsSince(time));
+    }
+    return benchResult;
+}
+
+bool writeResults(std::ostream& stream) {
+    const VkPhysicalDeviceProperties& properties = GraphicsBase::getBase().getPhysicalDeviceProperties();
+    stream << std::format(
+        "{{\n  \"device\": \"{}\",\n  \"driver_version\": {},\n  \"api_version\": \"{}.{}.{}\",\n  \"unit\": \"us\",\n  \"benchmarks\": [",
+        properties.deviceName, properties.driverVersion,
+        VK_VERSION_MAJOR(properties.apiVersion), VK_VERSION_MINOR(properties.apiVersion), VK_VERSION_PATCH(properties.apiVersion));
+    const char* separator = "\n";
+    for (auto& i : benchResults) {
+        std::vector<double> sorted = i.samples;
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](double p) { return sorted[size_t(p * (sorted.size() - 1))]; };
+        stream << std::format(
+            "{}    {{ \"name\": \"{}\", \"iterations\": {}, \"mean\": {:.3f}, \"min\": {:.3f}, \"p50\": {:.3f}, \"p99\": {:.3f}, \"max\": {:.3f}",
+            separator, i.name, sorted.size(),
+            std::accumulate(sorted.begin(), sorted.end(), 0.) / sorted.size(),
+            sorted.front(), percentile(.5), percentile(.99), sorted.back());
+        if (i.rateUnit)
+            stream << std::format(", \"{}\": {:.1f}", i.rateUnit, i.rate);
+        stream << " }";
+        separator = ",\n";
+    }
+    stream << "\n  ]";
+    if (pooledHostAllocator) {
+        static constexpr const char* scopeNames[] = { "command", "object", "cache", "device", "instance" };
+        stream << std::format(",\n  \"host_memory\": {{ \"slab_bytes\": {}, \"system_allocations\": {}, \"scopes\": [",
+            HostAllocator::getSlabBytes(), HostAllocator::getSystemAllocationCount());
+        separator = "\n";
+        for (uint32_t i = 0; i < std::size(scopeNames); i++) {
+            const HostAllocator::Statistics& statistics = HostAllocator::getStatistics(VkSystemAllocationScope(i));
+            stream << std::format(
+                "{}    {{ \"scope\": \"{}\", \"bytes\": {}, \"peak_bytes\": {}, \"allocations\": {}, \"internal_bytes\": {} }}",
+                separator, scopeNames[i], statistics.bytes.load(), statistics.peakBytes.load(),
+                statistics.allocationCount.load(), statistics.internalBytes.load());
+            separator = ",\n";
+        }
+        stream << "\n  ] }";
+    }
+    stream << "\n}\n";
+    return bool(stream);
+}
+
+// Instance, device and headless swapchain creation, each from scratch. Leaves the last ones alive.
+void benchInitialization(VkExtent2D extent) {
+    BenchResult& resultInstance = addResult("create_instance");
+    BenchResult& resultDevice = addResult("create_device");
+    BenchResult& resultSwapchain = addResult("create_swapchain_headless");
+    GraphicsBase& base = GraphicsBase::getBase();
+    for (uint32_t i = iterations(5); i--;) {
+        auto time = std::chrono::steady_clock::now();
+        if (base.createInstance())
+            throw std::runtime_error("Error while creating instance.");
+        resultInstance.samples.push_back(microsecondsSince(time));
+
+        time = std::chrono::steady_clock::now();
+        if (base.getPhysicalDevices() ||
+            base.determinePhysicalDevice(0, true, false))
+            throw std::runtime_error("Error while creating devices.");
+        const char* swapchainExtension[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+        if (!base.checkDeviceExtensions(swapchainExtension) && swapchainExtension[0])
+            base.pushDeviceExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        else
+            base.headlessImageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        if (base.createDevice())
+            throw std::runtime_error("Error while creating devices.");
+        resultDevice.samples.push_back(microsecondsSince(time));
+
+        time = std::chrono::steady_clock::now();
+        if (base.createHeadlessSwapchain(extent))
+            throw std::runtime_error("Error while creating headless images.");
+        resultSwapchain.samples.push_back(microsecondsSince(time));
+
+        if (i)
+            base.terminate();
+    }
+}
+
+void benchShaderModules() {
+    measure("shader_module_load", iterations(100), [] {
+        ShaderModule vert("triangle.vert.spv");
+        ShaderModule frag("triangle.frag.spv");
+    });
+}
+
+// The same pipeline as the triangle of main.cpp.
+GraphicsPipelineCreateInfoPack trianglePipelineCiPack(VkRenderPass renderPass, VkPipelineLayout pipelineLayout,
+    const ShaderModule& vert, const ShaderModule& frag) {
+    GraphicsPipelineCreateInfoPack pipelineCiPack;
+    pipelineCiPack.createInfo.layout = pipelineLayout;
+    pipelineCiPack.createInfo.renderPass = renderPass;
+    pipelineCiPack.inputAssemblyStateCi.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+    pipelineCiPack.useDynamicViewportAndScissor();
+    pipelineCiPack.multisampleStateCi.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    pipelineCiPack.colorBlendAttachmentStates.push_back({ .colorWriteMask = 0b1111 });
+    pipelineCiPack.shaderStages.push_back(vert.stageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT));
+    pipelineCiPack.shaderStages.push_back(frag.stageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT));
+    pipelineCiPack.updateAllArrays();
+    return pipelineCiPack;
+}
+
+void benchPipelineCreation(VkRenderPass renderPass, VkPipelineLayout pipelineLayout) {
+    ShaderModule vert("triangle.vert.spv");
+    ShaderModule frag("triangle.frag.spv");
+    GraphicsPipelineCreateInfoPack pipelineCiPack = trianglePipelineCiPack(renderPass, pipelineLayout, vert, frag);
+    measure("pipeline_create", iterations(50), [&] {
+        Pipeline pipeline(pipelineCiPack);
+    });
+
+    // 64 pipelines at a time, in one call, then split among the cores.
+    std::vector<GraphicsPipelineCreateInfoPack> pipelineCiPacks(64, pipelineCiPack);
+    measure("pipeline_create_batched_64", iterations(10), [&] {
+        std::vector<Pipeline> pipelines(pipelineCiPacks.size());
+        Pipeline::create(pipelineCiPacks, pipelines);
+    });
+    measure("pipeline_create_parallel_64", iterations(10), [&] {
+        std::vector<Pipeline> pipelines(pipelineCiPacks.size());
+        Pipeline::createAsync(pipelineCiPacks, pipelines).get();
+    });
+
+    // Hashing and lookup of a pipeline already built.
+    PipelineRegistry pipelineRegistry;
+    VkPipeline pipeline;
+    pipelineRegistry.get(pipelineCiPack, pipeline);
+    measure("pipeline_registry_hit", iterations(1000), [&] {
+        pipelineRegistry.get(pipelineCiPack, pipeline);
+    });
+}
+
+// Records a render pass with one draw per command buffer and submits it through the timeline batcher,
+// keeping as many command buffers in flight as there are frames in flight.
+void benchRecordSubmit(const EasyVulkan::RenderPassWithFramebuffers& rpwf, VkPipeline pipeline) {
+    GraphicsBase& base = GraphicsBase::getBase();
+    CommandPool commandPool(base.getQueueFamilyIndexGraphics(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    std::vector<CommandBuffer> commandBuffers(base.getMaxFramesInFlight());
+    std::vector<uint64_t> timelineValues(commandBuffers.size());
+    commandPool.allocateBuffers({ commandBuffers.data(), commandBuffers.size() });
+    VkClearValue clearColor = { .color = { 0.f, 0.f, 0.f, 1.f } };
+
+    uint32_t count = iterations(2000);
+    BenchResult& resultRecord = addResult("command_buffer_record");
+    BenchResult& resultSubmit = addResult("command_buffer_submit");
+    auto timeBegin = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < count; i++) {
+        size_t slot = i % commandBuffers.size();
+        base.waitTimeline(GraphicsBase::timelineGraphics, timelineValues[slot]);
+
+        auto time = std::chrono::steady_clock::now();
+        commandBuffers[slot].begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+        rpwf.renderPass.cmdBegin(commandBuffers[slot], rpwf.framebuffers[i % rpwf.framebuffers.size()], { {}, windowSize }, clearColor);
+        vkCmdBindPipeline(commandBuffers[slot], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+        commandBuffers[slot].setViewportAndScissor({ {}, windowSize });
+        vkCmdDraw(commandBuffers[slot], 3, 1, 0, 0);
+        rpwf.renderPass.cmdEnd(commandBuffers[slot]);
+        commandBuffers[slot].end();
+        resultRecord.samples.push_back(microsecondsSince(time));
+
+        time = std::chrono::steady_clock::now();
+        base.submitTimelined(GraphicsBase::timelineGraphics, commandBuffers[slot], {},
+            VK_NULL_HANDLE, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_NULL_HANDLE, &timelineValues[slot]);
+        resultSubmit.samples.push_back(microsecondsSince(time));
+    }
+    base.waitIdle();
+    resultSubmit.rateUnit = "submits_per_second";
+    resultSubmit.rate = count / (microsecondsSince(timeBegin) / 1'000'000);
+}
+
+// An empty submission signaling a fence, waited for and reset on the CPU.
+void benchFenceRoundTrip() {
+    Fence fence;
+    measure("fence_round_trip", iterations(1000), [&fence] {
+        VkSubmitInfo submitInfo = {};
+        GraphicsBase::getBase().submitCommandBufferGraphics(submitInfo, fence);
+        fence.waitAndReset();
+    });
+}
+
+// Recreation of the headless image ring, including the callbacks which rebuild framebuffers.
+void benchSwapchainRecreation() {
+    measure("swapchain_recreate", iterations(50), [] {
+        GraphicsBase::getBase().recreateSwapchain();
+    });
+    GraphicsBase::getBase().waitIdle();
+    GraphicsBase::getBase().collectRetiredSwapchains();
+}
+
+int main(int argc, char* argv[]) {
+    const char* outPath = nullptr;
+    for (int i = 1; i < argc; i++)
+        if (!strcmp(argv[i], "--pooled-host-allocator"))
+            pooledHostAllocator = true;
+        else if (i + 1 == argc)
+            break;
+        else if (!strcmp(argv[i], "--out"))
+            outPath = argv[++i];
+        else if (!strcmp(argv[i], "--iterations-scale"))
+            iterationsScale = std::max(std::atof(argv[++i]), 0.);
+    if (pooledHostAllocator)
+        HostAllocator::usePools();
+
+    benchInitialization(defaultWindowSize);
+    benchShaderModules();
+    {
+        const auto& rpwf = EasyVulkan::createRpwfScreen();
+        VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+        PipelineLayout pipelineLayout(pipelineLayoutCreateInfo);
+        benchPipelineCreation(rpwf.renderPass, pipelineLayout);
+
+        ShaderModule vert("triangle.vert.spv");
+        ShaderModule frag("triangle.frag.spv");
+        GraphicsPipelineCreateInfoPack pipelineCiPack = trianglePipelineCiPack(rpwf.renderPass, pipelineLayout, vert, frag);
+        Pipeline pipeline(pipelineCiPack);
+        benchRecordSubmit(rpwf, pipeline);
+        benchFenceRoundTrip();
+        benchSwapchainRecreation();
+    }
+
+    if (outPath) {
+        std::ofstream file(outPath);
+        if (!file || !writeResults(file)) {
+            outStream << std::format("Failed to write the file: {}", outPath) << std::endl;
+            return 1;
+        }
+    }
+    else
+        writeResults(std::cout);
+    GraphicsBase::getBase().waitIdle();
+    return 0;
+}
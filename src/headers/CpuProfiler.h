@@ -0,0 +1,136 @@
+#pragma once
+
+// Scoped CPU zones, enabled by defining VK_CPU_PROFILER. Without it, cpuZone() expands to nothing.
+// Usage: { cpuZone("Name"); ... } records the enclosing scope; CpuProfiler::exportChromeTrace() writes
+// the zones as Chrome trace events, which chrome://tracing and Perfetto can open.
+#ifdef VK_CPU_PROFILER
+#include <atomic>
+#include <mutex>
+#if defined _MSC_VER && (defined _M_X64 || defined _M_IX86)
+#include <intrin.h>
+#define VK_CPU_PROFILER_TSC
+#elif defined __x86_64__ || defined __i386__
+#include <x86intrin.h>
+#define VK_CPU_PROFILER_TSC
+#endif
+
+namespace Vulkan {
+
+    class CpuProfiler {
+    public:
+        // The invariant TSC where available, which costs a few nanoseconds to read, otherwise steady_clock in nanoseconds.
+        static uint64_t ticks() {
+#ifdef VK_CPU_PROFILER_TSC
+            return __rdtsc();
+#else
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+        }
+
+    private:
+        struct Event {
+            const char* name;
+            uint64_t begin;
+            uint64_t end;
+        };
+        // Written by its own thread only. Once full, the oldest events are overwritten.
+        struct ThreadBuffer {
+            static constexpr uint32_t capacity = 1 << 15;
+            Event events[capacity];
+            std::atomic<uint64_t> eventCount = 0;
+            uint32_t threadId;
+            const char* threadName = nullptr;
+        };
+
+        // Buffers outlive their threads so that zones of finished threads can still be exported.
+        inline static std::mutex mutexBuffers;
+        inline static std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        inline static thread_local ThreadBuffer* pThreadBuffer = nullptr;
+        inline static const uint64_t tickBegin = ticks();
+        inline static const std::chrono::steady_clock::time_point timeBegin = std::chrono::steady_clock::now();
+
+        static ThreadBuffer& threadBuffer() {
+            if (!pThreadBuffer) {
+                std::lock_guard lock(mutexBuffers);
+                pThreadBuffer = buffers.emplace_back(std::make_unique<ThreadBuffer>()).get();
+                pThreadBuffer->threadId = uint32_t(buffers.size());
+            }
+            return *pThreadBuffer;
+        }
+
+        // Ticks per microsecond, measured over the whole lifetime of the profiler so far.
+        static double ticksPerMicrosecond() {
+#ifdef VK_CPU_PROFILER_TSC
+            double microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - timeBegin).count();
+            return microseconds ? (ticks() - tickBegin) / microseconds : 1;
+#else
+            return 1000;
+#endif
+        }
+
+    public:
+        static void record(const char* name, uint64_t begin, uint64_t end) {
+            ThreadBuffer& buffer = threadBuffer();
+            uint64_t count = buffer.eventCount.load(std::memory_order_relaxed);
+            buffer.events[count % ThreadBuffer::capacity] = { name, begin, end };
+            buffer.eventCount.store(count + 1, std::memory_order_release);
+        }
+
+        // Names the calling thread in the exported trace.
+        static void setThreadName(const char* name) {
+            threadBuffer().threadName = name;
+        }
+
+        // Safe to call while other threads keep recording, events overwritten during the export are dropped.
+        static bool exportChromeTrace(const char* filepath) {
+            std::ofstream file(filepath);
+            if (!file) {
+                outStream << std::format("Failed to open the file: {}", filepath) << std::endl;
+                return false;
+            }
+            double scale = 1 / ticksPerMicrosecond();
+            std::lock_guard lock(mutexBuffers);
+            file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+            const char* separator = "\n";
+            for (auto& i : buffers) {
+                if (i->threadName)
+                    file << std::format("{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+                        separator, i->threadId, i->threadName),
+                    separator = ",\n";
+                uint64_t end = i->eventCount.load(std::memory_order_acquire);
+                uint64_t begin = end - std::min<uint64_t>(end, ThreadBuffer::capacity);
+                std::vector<Event> events(size_t(end - begin));
+                for (uint64_t j = begin; j < end; j++)
+                    events[size_t(j - begin)] = i->events[j % ThreadBuffer::capacity];
+                uint64_t endAfterCopy = i->eventCount.load(std::memory_order_acquire);
+                // The thread may be in the middle of the event at endAfterCopy, whose slot holds endAfterCopy - capacity.
+                size_t overwritten = endAfterCopy - begin >= ThreadBuffer::capacity ?
+                    size_t(std::min<uint64_t>(events.size(), endAfterCopy - begin - ThreadBuffer::capacity + 1)) : 0;
+                for (size_t j = overwritten; j < events.size(); j++) {
+                    file << std::format("{}{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                        separator, events[j].name, i->threadId,
+                        (events[j].begin - tickBegin) * scale, (events[j].end - events[j].begin) * scale);
+                    separator = ",\n";
+                }
+            }
+            file << "\n]}\n";
+            return true;
+        }
+    };
+
+    class CpuZone {
+        const char* name;
+        uint64_t begin;
+    public:
+        CpuZone(const char* name) :name(name), begin(CpuProfiler::ticks()) {}
+        CpuZone(CpuZone&&) = delete;
+        ~CpuZone() { CpuProfiler::record(name, begin, CpuProfiler::ticks()); }
+    };
+}
+
+#define cpuZoneConcatenate(a, b) a##b
+#define cpuZoneVariable(line) cpuZoneConcatenate(cpuZone_, line)
+#define cpuZone(name) Vulkan::CpuZone cpuZoneVariable(__LINE__)(name)
+#else
+#define cpuZone(name)
+#endif
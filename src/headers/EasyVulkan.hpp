@@ -11,6 +11,42 @@ namespace EasyVulkan {
         RenderPass renderPass;
         std::vector<Framebuffer> framebuffers;
     };
+
+    // Per-slot synchronization objects and command buffer of the frames-in-flight ring.
+    // timelineValue is the graphics timeline value signaled by the slot's last submission.
+    struct FrameInFlight {
+        uint64_t timelineValue = 0;
+        Semaphore semaphoreImageIsAvailable;
+        CommandBuffer commandBuffer;
+    };
+
+    std::vector<FrameInFlight> createFramesInFlight(const CommandPool& commandPool) {
+        std::vector<FrameInFlight> frames(GraphicsBase::getBase().getMaxFramesInFlight());
+        for (auto& i : frames)
+            commandPool.allocateBuffers(i.commandBuffer);
+        return frames;
+    }
+    // Semaphores signaled when rendering to a swapchain image is over and waited on by its present, one per image.
+    // A frame slot comes around again before the presentation engine is known to have waited on what the slot
+    // signaled last time, whereas an image is acquired again only after its previous present has been processed.
+    const auto& createSemaphoresRenderingIsOver() {
+        static std::vector<Semaphore> semaphores;
+        if (semaphores.size())
+            outStream << std::format("createSemaphoresRenderingIsOver() is called more than once.") << std::endl;
+
+        auto createSemaphores = [] {
+            semaphores.resize(GraphicsBase::getBase().getSwapchainImageCount());
+        };
+        auto destroySemaphores = [] {
+            auto retired = std::make_shared<std::vector<Semaphore>>(std::move(semaphores));
+            GraphicsBase::getBase().deferDestruction([retired] { retired->clear(); });
+            semaphores.clear();
+        };
+        GraphicsBase::getBase().pushCallbackCreateSwapchain(createSemaphores);
+        GraphicsBase::getBase().pushCallbackDestroySwapchain(destroySemaphores);
+        createSemaphores();
+        return semaphores;
+    }
     const auto& createRpwfScreen() {
         static RenderPassWithFramebuffers rpwfScreen;
         if (rpwfScreen.renderPass)
@@ -84,6 +120,8 @@ namespace EasyVulkan {
             }
         };
         auto destroyFramebuffers = [] {
+            auto framebuffers = std::make_shared<std::vector<Framebuffer>>(std::move(rpwfScreen.framebuffers));
+            GraphicsBase::getBase().deferDestruction([framebuffers] { framebuffers->clear(); });
             rpwfScreen.framebuffers.clear();
         };
         GraphicsBase::getBase().pushCallbackCreateSwapchain(createFramebuffers);
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "./VKBase.h"
+
+namespace Vulkan {
+
+    // Caps the frame rate on the CPU and chooses how frames are handed to the presentation engine.
+    class FrameGovernor {
+    public:
+        enum PresentStrategy {
+            // IMMEDIATE > MAILBOX > FIFO_RELAXED > FIFO, tearing allowed.
+            presentStrategyLowestLatency,
+            // MAILBOX > FIFO, no tearing, the newest frame replaces queued ones.
+            presentStrategyNoTearing,
+            // FIFO_RELAXED > FIFO, vsync that tears instead of stuttering on a late frame.
+            presentStrategyAdaptiveVsync,
+            // FIFO, the display paces the frames.
+            presentStrategyVsync
+        };
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        clock::duration framePeriod = {};
+        clock::time_point frameDeadline = {};
+        // How much longer than requested sleep_for() tends to take, estimated at runtime. Only the remaining
+        // time beyond it is slept, the rest is spun on, which keeps the deadline sub-millisecond accurate.
+        clock::duration sleepOvershoot = std::chrono::microseconds(1000);
+        double targetFps = 0;
+
+    public:
+        double getTargetFps() const { return targetFps; }
+
+        // 0 removes the cap.
+        void setTargetFps(double fps) {
+            targetFps = std::max(fps, 0.);
+            framePeriod = targetFps ?
+                std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1. / targetFps)) :
+                clock::duration {};
+            frameDeadline = clock::now();
+        }
+
+        result_t setPresentStrategy(PresentStrategy strategy) const {
+            static constexpr VkPresentModeKHR lowestLatency[] = {
+                VK_PRESENT_MODE_IMMEDIATE_KHR, VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+            static constexpr VkPresentModeKHR noTearing[] = { VK_PRESENT_MODE_MAILBOX_KHR };
+            static constexpr VkPresentModeKHR adaptiveVsync[] = { VK_PRESENT_MODE_FIFO_RELAXED_KHR };
+            switch (strategy) {
+            case presentStrategyLowestLatency:
+                return GraphicsBase::getBase().setPresentMode(lowestLatency);
+            case presentStrategyNoTearing:
+                return GraphicsBase::getBase().setPresentMode(noTearing);
+            case presentStrategyAdaptiveVsync:
+                return GraphicsBase::getBase().setPresentMode(adaptiveVsync);
+            default:
+                return GraphicsBase::getBase().setPresentMode({});
+            }
+        }
+
+        // Call once per frame. Returns when the next frame is due.
+        void wait() {
+            if (!targetFps)
+                return;
+            frameDeadline += framePeriod;
+            clock::time_point now = clock::now();
+            // Behind schedule by more than a frame, start over instead of rushing to catch up.
+            if (now > frameDeadline + framePeriod) {
+                frameDeadline = now;
+                return;
+            }
+            while (frameDeadline - now > sleepOvershoot) {
+                clock::duration requested = frameDeadline - now - sleepOvershoot;
+                std::this_thread::sleep_for(requested);
+                clock::time_point woken = clock::now();
+                clock::duration overshoot = woken - now - requested;
+                sleepOvershoot = (sleepOvershoot * 7 + overshoot) / 8;
+                now = woken;
+            }
+            while (clock::now() < frameDeadline)
+                std::this_thread::yield();
+        }
+    };
+}
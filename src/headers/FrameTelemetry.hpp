@@ -0,0 +1,195 @@
+#pragma once
+
+#include "./VKBase.h"
+#include <atomic>
+
+namespace Vulkan {
+
+    // Per-frame CPU timings kept in a lock-free ring. The render thread is the only writer, statistics and
+    // exports may be taken from any thread and skip the records overwritten while they were being read.
+    class FrameTelemetry {
+    public:
+        enum Phase : uint32_t {
+            // Blocked on the GPU or on frame pacing.
+            phaseWait,
+            phaseAcquire,
+            phaseRecord,
+            phaseSubmit,
+            phasePresent,
+            phaseCount
+        };
+        struct FrameRecord {
+            uint64_t frameNumber;
+            // Seconds since the telemetry was created.
+            double timeBegin;
+            // Milliseconds, begin of this frame to begin of the next one.
+            float frameTime;
+            float phaseTimes[phaseCount];
+            // GPU time of the latest frame read back by the GPU profiler, lagging by the frames in flight.
+            float gpuTime;
+            // Pipeline statistics of the same frame, all zero unless collected.
+            PipelineStatistics gpuStatistics;
+            bool hitch;
+        };
+        struct Statistics {
+            uint32_t frameCount = 0;
+            double average = 0;
+            double p50 = 0;
+            double p95 = 0;
+            double p99 = 0;
+            double max = 0;
+            uint64_t hitchCount = 0;
+        };
+        static constexpr uint32_t capacity = 4096;
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        FrameRecord records[capacity] = {};
+        std::atomic<uint64_t> recordCount = 0;
+        std::atomic<uint64_t> hitchCount = 0;
+
+        clock::time_point timeCreated = clock::now();
+        clock::time_point timeFrameBegin;
+        clock::time_point timeLastMark;
+        FrameRecord current = {};
+        bool frameBegun = false;
+        // A frame is a hitch when it takes hitchFactor times the moving average of the frame time.
+        double hitchFactor = 2;
+        double averageFrameTime = 0;
+
+        static double milliseconds(clock::duration duration) {
+            return std::chrono::duration<double, std::milli>(duration).count();
+        }
+
+        // Copies up to frameCount of the newest records that were not overwritten while being copied.
+        std::vector<FrameRecord> snapshot(uint32_t frameCount) const {
+            uint64_t end = recordCount.load(std::memory_order_acquire);
+            uint64_t begin = end - std::min<uint64_t>(end, std::min(frameCount, capacity));
+            std::vector<FrameRecord> result(size_t(end - begin));
+            for (uint64_t i = begin; i < end; i++)
+                result[size_t(i - begin)] = records[i % capacity];
+            // The writer may be in the middle of the record at endAfterCopy, whose slot holds endAfterCopy - capacity.
+            uint64_t endAfterCopy = recordCount.load(std::memory_order_acquire);
+            if (endAfterCopy - begin >= capacity)
+                result.erase(result.begin(), result.begin() + std::min<size_t>(result.size(), size_t(endAfterCopy - begin - capacity + 1)));
+            return result;
+        }
+
+    public:
+        double getHitchFactor() const { return hitchFactor; }
+        void setHitchFactor(double factor) { hitchFactor = factor; }
+        uint64_t getFrameCount() const { return recordCount.load(std::memory_order_acquire); }
+        uint64_t getHitchCount() const { return hitchCount.load(std::memory_order_relaxed); }
+
+        // Ends the previous frame, if any, and starts timing a new one.
+        void beginFrame() {
+            clock::time_point now = clock::now();
+            if (frameBegun) {
+                current.frameTime = float(milliseconds(now - timeFrameBegin));
+                current.hitch = averageFrameTime && current.frameTime > hitchFactor * averageFrameTime;
+                averageFrameTime = averageFrameTime ? averageFrameTime * .95 + current.frameTime * .05 : current.frameTime;
+                uint64_t count = recordCount.load(std::memory_order_relaxed);
+                records[count % capacity] = current;
+                recordCount.store(count + 1, std::memory_order_release);
+                if (current.hitch)
+                    hitchCount.fetch_add(1, std::memory_order_relaxed);
+            }
+            current = {
+                .frameNumber = recordCount.load(std::memory_order_relaxed),
+                .timeBegin = std::chrono::duration<double>(now - timeCreated).count()
+            };
+            timeFrameBegin = timeLastMark = now;
+            frameBegun = true;
+        }
+
+        void setGpuTime(double milliseconds) {
+            current.gpuTime = float(milliseconds);
+        }
+        void setGpuStatistics(const PipelineStatistics& statistics) {
+            current.gpuStatistics = statistics;
+        }
+
+        // Attributes the time since the last mark (or the begin of the frame) to phase.
+        void mark(Phase phase) {
+            clock::time_point now = clock::now();
+            current.phaseTimes[phase] += float(milliseconds(now - timeLastMark));
+            timeLastMark = now;
+        }
+
+        Statistics computeStatistics(uint32_t frameCount = capacity) const {
+            std::vector<FrameRecord> frames = snapshot(frameCount);
+            Statistics statistics;
+            statistics.hitchCount = getHitchCount();
+            if (frames.empty())
+                return statistics;
+            std::vector<float> frameTimes(frames.size());
+            for (size_t i = 0; i < frames.size(); i++)
+                frameTimes[i] = frames[i].frameTime;
+            auto percentile = [&frameTimes](double p) {
+                auto i = frameTimes.begin() + size_t(p * (frameTimes.size() - 1));
+                std::nth_element(frameTimes.begin(), i, frameTimes.end());
+                return double(*i);
+            };
+            statistics.frameCount = uint32_t(frames.size());
+            statistics.average = std::accumulate(frameTimes.begin(), frameTimes.end(), 0.) / frameTimes.size();
+            statistics.max = *std::max_element(frameTimes.begin(), frameTimes.end());
+            statistics.p50 = percentile(.5);
+            statistics.p95 = percentile(.95);
+            statistics.p99 = percentile(.99);
+            return statistics;
+        }
+
+        bool exportCsv(const char* filepath) const {
+            std::ofstream file(filepath);
+            if (!file) {
+                outStream << std::format("Failed to open the file: {}", filepath) << std::endl;
+                return false;
+            }
+            file << "frame,time_s,frame_ms,wait_ms,acquire_ms,record_ms,submit_ms,present_ms,gpu_ms,vs_invocations,clip_primitives,fs_invocations,cs_invocations,hitch\n";
+            for (auto& i : snapshot(capacity))
+                file << std::format("{},{:.6f},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f},{:.3f},{},{},{},{},{}\n",
+                    i.frameNumber, i.timeBegin, i.frameTime,
+                    i.phaseTimes[phaseWait], i.phaseTimes[phaseAcquire], i.phaseTimes[phaseRecord],
+                    i.phaseTimes[phaseSubmit], i.phaseTimes[phasePresent], i.gpuTime,
+                    i.gpuStatistics.vertexShaderInvocations, i.gpuStatistics.clippingPrimitives,
+                    i.gpuStatistics.fragmentShaderInvocations, i.gpuStatistics.computeShaderInvocations, int(i.hitch));
+            return true;
+        }
+
+        bool exportJson(const char* filepath) const {
+            std::ofstream file(filepath);
+            if (!file) {
+                outStream << std::format("Failed to open the file: {}", filepath) << std::endl;
+                return false;
+            }
+            Statistics statistics = computeStatistics();
+            file << std::format(
+                "{{\n  \"statistics\": {{ \"frames\": {}, \"average_ms\": {:.3f}, \"p50_ms\": {:.3f}, \"p95_ms\": {:.3f}, "
+                "\"p99_ms\": {:.3f}, \"max_ms\": {:.3f}, \"hitches\": {} }},\n  \"frames\": [",
+                statistics.frameCount, statistics.average, statistics.p50, statistics.p95,
+                statistics.p99, statistics.max, statistics.hitchCount);
+            const char* separator = "\n";
+            for (auto& i : snapshot(capacity)) {
+                file << std::format(
+                    "{}    {{ \"frame\": {}, \"time_s\": {:.6f}, \"frame_ms\": {:.3f}, \"wait_ms\": {:.3f}, \"acquire_ms\": {:.3f}, "
+                    "\"record_ms\": {:.3f}, \"submit_ms\": {:.3f}, \"present_ms\": {:.3f}, \"gpu_ms\": {:.3f}, "
+                    "\"vs_invocations\": {}, \"clip_primitives\": {}, \"fs_invocations\": {}, \"cs_invocations\": {}, \"hitch\": {} }}",
+                    separator, i.frameNumber, i.timeBegin, i.frameTime,
+                    i.phaseTimes[phaseWait], i.phaseTimes[phaseAcquire], i.phaseTimes[phaseRecord],
+                    i.phaseTimes[phaseSubmit], i.phaseTimes[phasePresent], i.gpuTime,
+                    i.gpuStatistics.vertexShaderInvocations, i.gpuStatistics.clippingPrimitives,
+                    i.gpuStatistics.fragmentShaderInvocations, i.gpuStatistics.computeShaderInvocations, i.hitch);
+                separator = ",\n";
+            }
+            file << "\n  ]\n}\n";
+            return true;
+        }
+
+        // Picks the format from the extension, JSON unless the path ends with ".csv".
+        bool exportToFile(const char* filepath) const {
+            std::string_view path = filepath;
+            return path.ends_with(".csv") ? exportCsv(filepath) : exportJson(filepath);
+        }
+    };
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "VKBase.h"
+#include "FrameTelemetry.hpp"
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 #pragma comment(lib, "glfw3.lib")
@@ -14,9 +15,61 @@ namespace GLFW {
     GLFWwindow* pWindow;
     GLFWmonitor* pMonitor;
     const char* windowTitle = "Vulkan Program";
+    Vulkan::FrameTelemetry frameTelemetry;
+
+    // Startup Phases
+    struct StartupPhase {
+        const char* name;
+        // Milliseconds since timeStartup.
+        double begin;
+        double duration;
+        bool mainThread;
+    };
+    // Set during static initialization, which is as close to the start of the process as a header gets.
+    const std::chrono::steady_clock::time_point timeStartup = std::chrono::steady_clock::now();
+    const std::thread::id mainThreadId = std::this_thread::get_id();
+    std::vector<StartupPhase> startupPhases;
+    std::mutex mutexStartupPhases;
+
+    // Records a startup phase from construction to next() or destruction. May be used from any thread.
+    class StartupPhaseTimer {
+        const char* name;
+        std::chrono::steady_clock::time_point timeBegin = std::chrono::steady_clock::now();
+    public:
+        StartupPhaseTimer(const char* name) :name(name) {}
+        StartupPhaseTimer(StartupPhaseTimer&&) = delete;
+        ~StartupPhaseTimer() { next(nullptr); }
+        // Ends the current phase and begins the next one, nullptr begins none.
+        void next(const char* nextName) {
+            using std::chrono::duration;
+            auto timeEnd = std::chrono::steady_clock::now();
+            if (name) {
+                std::lock_guard lock(mutexStartupPhases);
+                startupPhases.push_back({
+                    name,
+                    duration<double, std::milli>(timeBegin - timeStartup).count(),
+                    duration<double, std::milli>(timeEnd - timeBegin).count(),
+                    std::this_thread::get_id() == mainThreadId });
+            }
+            name = nextName;
+            timeBegin = timeEnd;
+        }
+    };
+
+    // Prints the recorded phases in the order they began, and the time since startup, e.g. once the first frame is presented.
+    void printStartupPhases(const char* milestone = "First frame") {
+        std::lock_guard lock(mutexStartupPhases);
+        std::sort(startupPhases.begin(), startupPhases.end(),
+            [](const StartupPhase& a, const StartupPhase& b) { return a.begin < b.begin; });
+        for (auto& i : startupPhases)
+            std::cout << std::format("{:<24} at {:8.2f} ms took {:8.2f} ms{}\n",
+                i.name, i.begin, i.duration, i.mainThread ? "" : " (worker)");
+        std::cout << std::format("{}: {:.2f} ms after startup",
+            milestone, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - timeStartup).count()) << std::endl;
+    }
 
     void initWindow(VkExtent2D size, bool fullScreen = false, bool isResizable = true, bool limitFrameRate = false) {
-        
+        StartupPhaseTimer phase("glfwInit");
         if (!glfwInit()) {
             throw std::runtime_error(Message::ERROR_CREATING_WINDOW);
         }
@@ -35,6 +88,24 @@ namespace GLFW {
             Vulkan::GraphicsBase::getBase().pushInstanceExtension(extensionNames[i]);
         Vulkan::GraphicsBase::getBase().pushDeviceExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 
+        // Present fences of VK_EXT_swapchain_maintenance1 let old swapchains retire without waiting for the queues.
+        const char* surfaceMaintenance1Extensions[] = {
+            VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME,
+            VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME
+        };
+        if (!Vulkan::GraphicsBase::getBase().checkInstanceExtensions(surfaceMaintenance1Extensions) &&
+            surfaceMaintenance1Extensions[0] && surfaceMaintenance1Extensions[1])
+            for (auto& i : surfaceMaintenance1Extensions)
+                Vulkan::GraphicsBase::getBase().pushInstanceExtension(i);
+
+        // The instance only needs the extension list, so it's created on another thread while this one,
+        // which GLFW requires for window creation, creates the window.
+        std::future<VkResult> instanceCreated = std::async(std::launch::async, [] {
+            StartupPhaseTimer phase("createInstance");
+            return VkResult(Vulkan::GraphicsBase::getBase().createInstance());
+        });
+
+        phase.next("createWindow");
         pMonitor = glfwGetPrimaryMonitor();
 
         const GLFWvidmode* pMode = glfwGetVideoMode(pMonitor);
@@ -43,46 +114,60 @@ namespace GLFW {
             glfwCreateWindow(pMode->width, pMode->height, windowTitle, pMonitor, nullptr) :
             glfwCreateWindow(size.width, size.height, windowTitle, nullptr, nullptr);
         
+        phase.next("waitInstance");
+        VkResult resultInstance = instanceCreated.get();
         if (!pWindow) {
             glfwTerminate();
             throw std::runtime_error(Message::ERROR_CREATING_WINDOW);
         }
+        if (resultInstance) throw std::runtime_error("Error while creating instance.");
 
-        #ifdef _WIN32
-            Vulkan::GraphicsBase::getBase().pushInstanceExtension("VK_KHR_surface");
-            Vulkan::GraphicsBase::getBase().pushInstanceExtension("VK_KHR_win32_surface");
-        #else
-            uint32_t extensionCount = 0;
-            const char** extensionNames;
-            extensionNames = glfwGetRequiredInstanceExtensions(&extensionCount);
-            if (!extensionNames) {
-                glfwTerminate();
-                return false;
-                throw std::runtime_error("Vulkan is not available on this machine!");
-            }
-            for (size_t i = 0; i < extensionCount; i++)
-                Vulkan::GraphicsBase::getBase().pushInstanceExtension(extensionNames[i]);
-        #endif
-
-            if (Vulkan::GraphicsBase::getBase().createInstance()) throw std::runtime_error("Error while creating instance.");
-
-            VkSurfaceKHR surface = VK_NULL_HANDLE;
-            if (VkResult result = glfwCreateWindowSurface(Vulkan::GraphicsBase::getBase().getInstance(), pWindow, nullptr, &surface)) {
-                glfwTerminate();
-                throw std::runtime_error(std::format("Failed to create a window surface!\nError code: {}\n", int32_t(result)));
-            }
-            Vulkan::GraphicsBase::getBase().setSurface(surface);
-
-            if (
-                Vulkan::GraphicsBase::getBase().getPhysicalDevices() ||
-                Vulkan::GraphicsBase::getBase().determinePhysicalDevice(0, true, false) ||
-                Vulkan::GraphicsBase::getBase().createDevice())
-                throw std::runtime_error("Error while creating devices.");
-
-            if (Vulkan::GraphicsBase::getBase().createSwapchain(limitFrameRate))
-                throw std::runtime_error("Error while creating Swapchain.");
-
+        phase.next("createSurface");
+        VkSurfaceKHR surface = VK_NULL_HANDLE;
+        if (VkResult result = glfwCreateWindowSurface(Vulkan::GraphicsBase::getBase().getInstance(), pWindow, Vulkan::HostAllocator::pCallbacks, &surface)) {
+            glfwTerminate();
+            throw std::runtime_error(std::format("Failed to create a window surface!\nError code: {}\n", int32_t(result)));
+        }
+        Vulkan::GraphicsBase::getBase().setSurface(surface);
+
+        phase.next("determinePhysicalDevice");
+        if (
+            Vulkan::GraphicsBase::getBase().getPhysicalDevices() ||
+            Vulkan::GraphicsBase::getBase().determinePhysicalDevice(0, true, false))
+            throw std::runtime_error("Error while creating devices.");
+        phase.next("createDevice");
+        if (Vulkan::GraphicsBase::getBase().createDevice())
+            throw std::runtime_error("Error while creating devices.");
+
+        phase.next("createSwapchain");
+        if (Vulkan::GraphicsBase::getBase().createSwapchain(limitFrameRate))
+            throw std::runtime_error("Error while creating Swapchain.");
+    }
 
+    // Runs without GLFW, a window or a surface, e.g. on a software ICD such as lavapipe. Frames are rendered to
+    // offscreen images which stand in for the swapchain, pWindow stays null.
+    void initHeadless(VkExtent2D size, bool readback = false) {
+        StartupPhaseTimer phase("createInstance");
+        if (Vulkan::GraphicsBase::getBase().createInstance()) throw std::runtime_error("Error while creating instance.");
+
+        phase.next("determinePhysicalDevice");
+        if (
+            Vulkan::GraphicsBase::getBase().getPhysicalDevices() ||
+            Vulkan::GraphicsBase::getBase().determinePhysicalDevice(0, true, false))
+            throw std::runtime_error("Error while creating devices.");
+        phase.next("createDevice");
+        // Lets render passes written for the swapchain keep VK_IMAGE_LAYOUT_PRESENT_SRC_KHR as their final layout.
+        const char* swapchainExtension[] = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+        if (!Vulkan::GraphicsBase::getBase().checkDeviceExtensions(swapchainExtension) && swapchainExtension[0])
+            Vulkan::GraphicsBase::getBase().pushDeviceExtension(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+        else
+            Vulkan::GraphicsBase::getBase().headlessImageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        if (Vulkan::GraphicsBase::getBase().createDevice())
+            throw std::runtime_error("Error while creating devices.");
+
+        phase.next("createSwapchain");
+        if (Vulkan::GraphicsBase::getBase().createHeadlessSwapchain(size, VK_FORMAT_R8G8B8A8_UNORM, 3, readback))
+            throw std::runtime_error("Error while creating headless images.");
     }
 
     void terminateWindow() {
@@ -90,25 +175,33 @@ namespace GLFW {
         glfwTerminate();
     }
 
+    // Always false in headless mode.
     bool shouldClose() {
-        return glfwWindowShouldClose(pWindow);
+        return pWindow && glfwWindowShouldClose(pWindow);
     }
 
+    // Starts timing a new frame and shows the frame statistics of the last second in the title once a second,
+    // or in headless mode, prints them.
     void fps() {
-        static double time0 = glfwGetTime();
-        static double time1;
-        static double dt;
-        static int dframe = -1;
-        static std::stringstream info;
-        time1 = glfwGetTime();
-        dframe++;
-        if ((dt = time1 - time0) >= 1) {
-            info.precision(1);
-            info << windowTitle << " | " << std::fixed << dframe / dt << " FPS";
-            glfwSetWindowTitle(pWindow, info.str().c_str());
-            info.str("");
+        using clock = std::chrono::steady_clock;
+        static clock::time_point time0 = clock::now();
+        static uint64_t frameCount0 = 0;
+        frameTelemetry.beginFrame();
+        clock::time_point time1 = clock::now();
+        double dt = std::chrono::duration<double>(time1 - time0).count();
+        if (dt >= 1) {
+            uint64_t frameCount1 = frameTelemetry.getFrameCount();
+            auto statistics = frameTelemetry.computeStatistics(uint32_t(frameCount1 - frameCount0));
+            std::string title = std::format(
+                "{} | {:.1f} FPS | p50 {:.2f} ms | p99 {:.2f} ms | max {:.2f} ms | {} hitches",
+                windowTitle, (frameCount1 - frameCount0) / dt,
+                statistics.p50, statistics.p99, statistics.max, statistics.hitchCount);
+            if (pWindow)
+                glfwSetWindowTitle(pWindow, title.c_str());
+            else
+                std::cout << title << std::endl;
             time0 = time1;
-            dframe = 0;
+            frameCount0 = frameCount1;
         }
     }
 }
\ No newline at end of file
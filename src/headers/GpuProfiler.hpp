@@ -0,0 +1,233 @@
+#pragma once
+
+#include "./VKBase.h"
+
+namespace Vulkan {
+
+    // GPU timestamps around render passes and user-named scopes. Every frame in flight owns a slice of one query
+    // pool; a slice is read back, using availability bits, when its frame slot comes around again, which is after
+    // the slot's previous submission has been waited for, so reading never stalls.
+    // Optionally, hooked render passes are also wrapped in pipeline statistics queries, kept in a second pool sliced the same way.
+    class GpuProfiler {
+    public:
+        struct ScopeResult {
+            const char* name;
+            uint32_t depth;
+            double milliseconds;
+            // Only render pass scopes carry statistics, and only if they were requested and supported.
+            bool hasStatistics;
+            PipelineStatistics statistics;
+        };
+
+    private:
+        struct Scope {
+            const char* name;
+            uint32_t depth;
+            // The begin timestamp, the end timestamp is the next query.
+            uint32_t query;
+            uint32_t statisticsQuery;
+        };
+        struct FrameSlot {
+            std::vector<Scope> scopes;
+            uint32_t queryCount = 0;
+            uint32_t statisticsQueryCount = 0;
+        };
+
+        QueryPool queryPool;
+        uint32_t maxQueriesPerFrame = 0;
+        uint32_t currentSlot = 0;
+        std::vector<FrameSlot> frameSlots;
+        std::vector<uint32_t> scopeStack;
+        std::vector<uint64_t> queryResults;
+        std::vector<ScopeResult> results;
+        double frameTime = 0;
+        double timestampPeriod = 1;
+        uint64_t timestampMask = ~0ull;
+        QueryPool statisticsPool;
+        uint32_t maxStatisticsQueriesPerFrame = 0;
+        // The scope whose pipeline statistics query is active, UINT32_MAX if none.
+        uint32_t statisticsScope = UINT32_MAX;
+        std::vector<uint64_t> statisticsResults;
+        PipelineStatistics frameStatistics = {};
+        std::unordered_map<VkRenderPass, const char*> renderPassNames;
+        inline static GpuProfiler* pHooked = nullptr;
+
+        static void cmdBeginRenderPassScope(VkCommandBuffer commandBuffer, VkRenderPass renderPass) {
+            auto i = pHooked->renderPassNames.find(renderPass);
+            pHooked->cmdBeginScope(commandBuffer, i == pHooked->renderPassNames.end() ? "RenderPass" : i->second);
+            pHooked->cmdBeginStatistics(commandBuffer);
+        }
+        static void cmdEndRenderPassScope(VkCommandBuffer commandBuffer, VkRenderPass) {
+            pHooked->cmdEndScope(commandBuffer);
+        }
+
+        // Queries of the same type can't be active at once in a command buffer, so only the outermost render pass gets one.
+        void cmdBeginStatistics(VkCommandBuffer commandBuffer) {
+            if (!isStatisticsEnabled() ||
+                statisticsScope != UINT32_MAX ||
+                scopeStack.empty() || scopeStack.back() == UINT32_MAX)
+                return;
+            FrameSlot& slot = frameSlots[currentSlot];
+            if (slot.statisticsQueryCount == maxStatisticsQueriesPerFrame)
+                return;
+            statisticsScope = scopeStack.back();
+            uint32_t query = currentSlot * maxStatisticsQueriesPerFrame + slot.statisticsQueryCount++;
+            slot.scopes[statisticsScope].statisticsQuery = query;
+            statisticsPool.cmdBegin(commandBuffer, query);
+        }
+
+        // Reads the slice of the current slot back into results. Scopes whose queries aren't available are left out.
+        void resolve(FrameSlot& slot) {
+            if (!slot.queryCount)
+                return;
+            // Each query yields its values followed by its availability.
+            constexpr uint32_t statisticsStride = PipelineStatistics::count + 1;
+            uint32_t firstQuery = currentSlot * maxQueriesPerFrame;
+            uint32_t firstStatisticsQuery = currentSlot * maxStatisticsQueriesPerFrame;
+            queryResults.resize(size_t(slot.queryCount) * 2);
+            VkResult result = queryPool.getResults(firstQuery, slot.queryCount, queryResults.size() * sizeof(uint64_t), queryResults.data(),
+                2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+            if (result && result != VK_NOT_READY)
+                return;
+            if (slot.statisticsQueryCount) {
+                statisticsResults.resize(size_t(slot.statisticsQueryCount) * statisticsStride);
+                result = statisticsPool.getResults(firstStatisticsQuery, slot.statisticsQueryCount, statisticsResults.size() * sizeof(uint64_t), statisticsResults.data(),
+                    statisticsStride * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+                if (result && result != VK_NOT_READY)
+                    slot.statisticsQueryCount = 0;
+            }
+            results.clear();
+            frameTime = 0;
+            frameStatistics = {};
+            for (auto& i : slot.scopes) {
+                const uint64_t* begin = &queryResults[size_t(i.query - firstQuery) * 2];
+                if (!begin[1] || !begin[3])
+                    continue;
+                double milliseconds = double((begin[2] - begin[0]) & timestampMask) * timestampPeriod / 1'000'000;
+                ScopeResult& scopeResult = results.emplace_back(ScopeResult{ i.name, i.depth, milliseconds });
+                if (!i.depth)
+                    frameTime += milliseconds;
+                if (i.statisticsQuery == UINT32_MAX ||
+                    i.statisticsQuery - firstStatisticsQuery >= slot.statisticsQueryCount)
+                    continue;
+                const uint64_t* values = &statisticsResults[size_t(i.statisticsQuery - firstStatisticsQuery) * statisticsStride];
+                if (!values[PipelineStatistics::count])
+                    continue;
+                scopeResult.hasStatistics = true;
+                memcpy(&scopeResult.statistics, values, sizeof scopeResult.statistics);
+                frameStatistics += scopeResult.statistics;
+            }
+        }
+
+    public:
+        GpuProfiler() = default;
+        GpuProfiler(uint32_t maxScopesPerFrame, bool pipelineStatistics = false) { create(maxScopesPerFrame, pipelineStatistics); }
+        GpuProfiler(GpuProfiler&&) = delete;
+        ~GpuProfiler() {
+            if (pHooked == this)
+                unhookRenderPasses();
+        }
+
+        bool isEnabled() const { return VkQueryPool(queryPool) != VK_NULL_HANDLE; }
+        bool isStatisticsEnabled() const { return VkQueryPool(statisticsPool) != VK_NULL_HANDLE; }
+        // Scopes of the last frame read back, in the order they began.
+        const std::vector<ScopeResult>& getResults() const { return results; }
+        // Sum of the outermost scopes of the last frame read back, in milliseconds.
+        double getFrameTime() const { return frameTime; }
+        // Sum over the render passes of the last frame read back, all zero if statistics are disabled.
+        const PipelineStatistics& getFrameStatistics() const { return frameStatistics; }
+
+        void setRenderPassName(VkRenderPass renderPass, const char* name) {
+            renderPassNames[renderPass] = name;
+        }
+
+        // Times every RenderPass::cmdBegin()/cmdEnd() pair as a scope. Only one profiler can be hooked at a time.
+        void hookRenderPasses() {
+            pHooked = this;
+            RenderPass::callbackCmdBegin = cmdBeginRenderPassScope;
+            RenderPass::callbackCmdEnd = cmdEndRenderPassScope;
+        }
+        void unhookRenderPasses() {
+            pHooked = nullptr;
+            RenderPass::callbackCmdBegin = nullptr;
+            RenderPass::callbackCmdEnd = nullptr;
+        }
+
+        // Call at the beginning of the frame's first command buffer, outside of any render pass.
+        void beginFrame(VkCommandBuffer commandBuffer) {
+            if (!isEnabled())
+                return;
+            currentSlot = GraphicsBase::getBase().getCurrentFrameIndex() % uint32_t(frameSlots.size());
+            FrameSlot& slot = frameSlots[currentSlot];
+            resolve(slot);
+            slot.scopes.clear();
+            slot.queryCount = 0;
+            slot.statisticsQueryCount = 0;
+            scopeStack.clear();
+            statisticsScope = UINT32_MAX;
+            queryPool.cmdReset(commandBuffer, currentSlot * maxQueriesPerFrame, maxQueriesPerFrame);
+            if (isStatisticsEnabled())
+                statisticsPool.cmdReset(commandBuffer, currentSlot * maxStatisticsQueriesPerFrame, maxStatisticsQueriesPerFrame);
+        }
+
+        void cmdBeginScope(VkCommandBuffer commandBuffer, const char* name) {
+            if (!isEnabled())
+                return;
+            FrameSlot& slot = frameSlots[currentSlot];
+            // Scopes beyond the capacity of the slice are not timed, but still have to be balanced.
+            if (slot.queryCount + 2 > maxQueriesPerFrame) {
+                scopeStack.push_back(UINT32_MAX);
+                return;
+            }
+            uint32_t query = currentSlot * maxQueriesPerFrame + slot.queryCount;
+            slot.queryCount += 2;
+            scopeStack.push_back(uint32_t(slot.scopes.size()));
+            slot.scopes.push_back({ name, uint32_t(scopeStack.size() - 1), query, UINT32_MAX });
+            queryPool.cmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query);
+        }
+
+        void cmdEndScope(VkCommandBuffer commandBuffer) {
+            if (!isEnabled() || scopeStack.empty())
+                return;
+            uint32_t scope = scopeStack.back();
+            scopeStack.pop_back();
+            if (scope == UINT32_MAX)
+                return;
+            const Scope& ended = frameSlots[currentSlot].scopes[scope];
+            if (scope == statisticsScope)
+                statisticsPool.cmdEnd(commandBuffer, ended.statisticsQuery),
+                statisticsScope = UINT32_MAX;
+            queryPool.cmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, ended.query + 1);
+        }
+
+        // Pipeline statistics are collected if requested and createDevice() found the pipelineStatisticsQuery feature.
+        result_t create(uint32_t maxScopesPerFrame = 32, bool pipelineStatistics = false) {
+            VkPhysicalDevice physicalDevice = GraphicsBase::getBase().getPhysicalDevice();
+            uint32_t queueFamilyCount = 0;
+            vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+            std::vector<VkQueueFamilyProperties> queueFamilyPropertieses(queueFamilyCount);
+            vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyPropertieses.data());
+            uint32_t timestampValidBits = queueFamilyPropertieses[GraphicsBase::getBase().getQueueFamilyIndexGraphics()].timestampValidBits;
+            if (!timestampValidBits) {
+                outStream << std::format("The graphics queue doesn't support timestamps, GPU profiling is disabled.") << std::endl;
+                return VK_RESULT_MAX_ENUM;
+            }
+            timestampMask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+            timestampPeriod = GraphicsBase::getBase().getPhysicalDeviceProperties().limits.timestampPeriod;
+
+            maxQueriesPerFrame = maxScopesPerFrame * 2;
+            frameSlots.resize(GraphicsBase::getBase().getMaxFramesInFlight());
+            if (result_t result = queryPool.create(VK_QUERY_TYPE_TIMESTAMP, maxQueriesPerFrame * uint32_t(frameSlots.size())))
+                return result;
+
+            if (!pipelineStatistics)
+                return VK_SUCCESS;
+            if (!GraphicsBase::getBase().getPhysicalDeviceFeatures().pipelineStatisticsQuery) {
+                outStream << std::format("The device doesn't support pipeline statistics queries, only timestamps are collected.") << std::endl;
+                return VK_SUCCESS;
+            }
+            maxStatisticsQueriesPerFrame = maxScopesPerFrame;
+            return statisticsPool.create(VK_QUERY_TYPE_PIPELINE_STATISTICS, maxStatisticsQueriesPerFrame * uint32_t(frameSlots.size()), PipelineStatistics::flags);
+        }
+    };
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include "./VKBase.h"
+
+namespace Vulkan {
+
+    // Builds each distinct pipeline once. Create infos are keyed by content: shader stages by their SPIR-V, entry
+    // point and specialization constants, then every fixed-function and dynamic state, the layout, the render pass
+    // and the subpass. Viewports and scissors are skipped when they are dynamic, since Vulkan ignores them then.
+    // The key is the whole of that content, its hash only picks the bucket, so distinct create infos never share
+    // a pipeline. Identical requests get the pipeline built by the first one, even while it's still being built.
+    // Render passes and layouts count by handle, pNext chains aren't keyed, so pipelines which need them should
+    // be created with Pipeline directly. Shader modules not created by ShaderModule have no known SPIR-V, and a
+    // handle may be reused by another module, so create infos with them aren't deduplicated: each request builds
+    // a pipeline of its own. Pipelines live until clear() or the destruction of the registry.
+    class PipelineRegistry {
+        struct Entry {
+            Pipeline pipeline;
+            std::promise<VkResult> promise;
+            std::shared_future<VkResult> built = promise.get_future().share();
+        };
+        // Serializes the fields which take part in the key. Arrays are preceded by their lengths and optional
+        // structures by whether they are present, so that distinct create infos can't serialize alike.
+        class KeyWriter {
+            std::string key;
+        public:
+            KeyWriter() { key.reserve(512); }
+            template<typename T>
+                requires std::is_scalar_v<T>
+            KeyWriter& operator<<(T data) {
+                key.append(reinterpret_cast<const char*>(&data), sizeof data);
+                return *this;
+            }
+            KeyWriter& operator<<(std::string_view data) {
+                *this << data.size();
+                key.append(data);
+                return *this;
+            }
+            std::string get() { return std::move(key); }
+        };
+
+        std::unordered_map<std::string, std::shared_ptr<Entry>> entries;
+        // Built for create infos without a key.
+        std::deque<Pipeline> pipelinesUnkeyed;
+        mutable std::mutex mutex;
+        uint64_t hitCount = 0;
+        uint64_t missCount = 0;
+
+        // Returns false if the SPIR-V of the module is unknown.
+        static bool writeStage(KeyWriter& writer, const VkPipelineShaderStageCreateInfo& stage) {
+            uint64_t codeId = ShaderModule::codeIdOf(stage.module);
+            if (!codeId)
+                return false;
+            writer << stage.flags << stage.stage << codeId << std::string_view(stage.pName);
+            const VkSpecializationInfo* pSpecializationInfo = stage.pSpecializationInfo;
+            writer << bool(pSpecializationInfo);
+            if (pSpecializationInfo) {
+                writer << pSpecializationInfo->mapEntryCount;
+                for (uint32_t i = 0; i < pSpecializationInfo->mapEntryCount; i++) {
+                    const VkSpecializationMapEntry& mapEntry = pSpecializationInfo->pMapEntries[i];
+                    writer << mapEntry.constantID << mapEntry.offset << mapEntry.size;
+                }
+                writer << std::string_view(static_cast<const char*>(pSpecializationInfo->pData), pSpecializationInfo->dataSize);
+            }
+            return true;
+        }
+        static void writeStencilOpState(KeyWriter& writer, const VkStencilOpState& state) {
+            writer << state.failOp << state.passOp << state.depthFailOp << state.compareOp
+                << state.compareMask << state.writeMask << state.reference;
+        }
+
+        template<typename CreateInfo>
+        result_t getInternal(const std::string& key, CreateInfo& createInfo, VkPipeline& pipeline) {
+            if (key.empty()) {
+                Pipeline pipelineUnkeyed;
+                VkResult result = pipelineUnkeyed.create(createInfo);
+                pipeline = pipelineUnkeyed;
+                std::lock_guard lock(mutex);
+                missCount++;
+                if (!result)
+                    pipelinesUnkeyed.push_back(std::move(pipelineUnkeyed));
+                return result;
+            }
+            std::shared_ptr<Entry> entry;
+            bool inserted;
+            {
+                std::lock_guard lock(mutex);
+                auto [i, insertedNew] = entries.try_emplace(key);
+                if (insertedNew)
+                    i->second = std::make_shared<Entry>();
+                entry = i->second;
+                inserted = insertedNew;
+                (inserted ? missCount : hitCount)++;
+            }
+            // Built outside of the lock, so that distinct pipelines are built in parallel.
+            if (inserted) {
+                VkResult result = entry->pipeline.create(createInfo);
+                if (result) {
+                    // Lets a later request try again.
+                    std::lock_guard lock(mutex);
+                    entries.erase(key);
+                }
+                entry->promise.set_value(result);
+            }
+            VkResult result = entry->built.get();
+            pipeline = entry->pipeline;
+            return result;
+        }
+
+    public:
+        PipelineRegistry() = default;
+        PipelineRegistry(PipelineRegistry&&) = delete;
+
+        uint64_t getHitCount() const {
+            std::lock_guard lock(mutex);
+            return hitCount;
+        }
+        uint64_t getMissCount() const {
+            std::lock_guard lock(mutex);
+            return missCount;
+        }
+        size_t getPipelineCount() const {
+            std::lock_guard lock(mutex);
+            return entries.size() + pipelinesUnkeyed.size();
+        }
+
+        // Returns an empty key for create infos which aren't deduplicated, see above.
+        static std::string key(const VkGraphicsPipelineCreateInfo& createInfo) {
+            KeyWriter writer;
+            writer << VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO << createInfo.flags << createInfo.stageCount;
+            for (uint32_t i = 0; i < createInfo.stageCount; i++)
+                if (!writeStage(writer, createInfo.pStages[i]))
+                    return {};
+
+            bool dynamicViewport = false;
+            bool dynamicScissor = false;
+            writer << bool(createInfo.pDynamicState);
+            if (const VkPipelineDynamicStateCreateInfo* pState = createInfo.pDynamicState) {
+                writer << pState->flags << pState->dynamicStateCount;
+                for (uint32_t i = 0; i < pState->dynamicStateCount; i++)
+                    writer << pState->pDynamicStates[i],
+                    dynamicViewport |= pState->pDynamicStates[i] == VK_DYNAMIC_STATE_VIEWPORT,
+                    dynamicScissor |= pState->pDynamicStates[i] == VK_DYNAMIC_STATE_SCISSOR;
+            }
+
+            writer << bool(createInfo.pVertexInputState);
+            if (const VkPipelineVertexInputStateCreateInfo* pState = createInfo.pVertexInputState) {
+                writer << pState->flags << pState->vertexBindingDescriptionCount << pState->vertexAttributeDescriptionCount;
+                for (uint32_t i = 0; i < pState->vertexBindingDescriptionCount; i++) {
+                    const VkVertexInputBindingDescription& binding = pState->pVertexBindingDescriptions[i];
+                    writer << binding.binding << binding.stride << binding.inputRate;
+                }
+                for (uint32_t i = 0; i < pState->vertexAttributeDescriptionCount; i++) {
+                    const VkVertexInputAttributeDescription& attribute = pState->pVertexAttributeDescriptions[i];
+                    writer << attribute.location << attribute.binding << attribute.format << attribute.offset;
+                }
+            }
+
+            writer << bool(createInfo.pInputAssemblyState);
+            if (const VkPipelineInputAssemblyStateCreateInfo* pState = createInfo.pInputAssemblyState)
+                writer << pState->flags << pState->topology << pState->primitiveRestartEnable;
+
+            writer << bool(createInfo.pTessellationState);
+            if (const VkPipelineTessellationStateCreateInfo* pState = createInfo.pTessellationState)
+                writer << pState->flags << pState->patchControlPoints;
+
+            writer << bool(createInfo.pViewportState);
+            if (const VkPipelineViewportStateCreateInfo* pState = createInfo.pViewportState) {
+                writer << pState->flags << pState->viewportCount << pState->scissorCount;
+                bool viewportsKeyed = pState->pViewports && !dynamicViewport;
+                writer << viewportsKeyed;
+                if (viewportsKeyed)
+                    for (uint32_t i = 0; i < pState->viewportCount; i++) {
+                        const VkViewport& viewport = pState->pViewports[i];
+                        writer << viewport.x << viewport.y << viewport.width << viewport.height << viewport.minDepth << viewport.maxDepth;
+                    }
+                bool scissorsKeyed = pState->pScissors && !dynamicScissor;
+                writer << scissorsKeyed;
+                if (scissorsKeyed)
+                    for (uint32_t i = 0; i < pState->scissorCount; i++) {
+                        const VkRect2D& scissor = pState->pScissors[i];
+                        writer << scissor.offset.x << scissor.offset.y << scissor.extent.width << scissor.extent.height;
+                    }
+            }
+
+            writer << bool(createInfo.pRasterizationState);
+            if (const VkPipelineRasterizationStateCreateInfo* pState = createInfo.pRasterizationState)
+                writer << pState->flags << pState->depthClampEnable << pState->rasterizerDiscardEnable
+                    << pState->polygonMode << pState->cullMode << pState->frontFace << pState->depthBiasEnable
+                    << pState->depthBiasConstantFactor << pState->depthBiasClamp << pState->depthBiasSlopeFactor << pState->lineWidth;
+
+            writer << bool(createInfo.pMultisampleState);
+            if (const VkPipelineMultisampleStateCreateInfo* pState = createInfo.pMultisampleState) {
+                writer << pState->flags << pState->rasterizationSamples << pState->sampleShadingEnable << pState->minSampleShading
+                    << pState->alphaToCoverageEnable << pState->alphaToOneEnable << bool(pState->pSampleMask);
+                if (pState->pSampleMask)
+                    for (uint32_t i = 0; i < (uint32_t(pState->rasterizationSamples) + 31) / 32; i++)
+                        writer << pState->pSampleMask[i];
+            }
+
+            writer << bool(createInfo.pDepthStencilState);
+            if (const VkPipelineDepthStencilStateCreateInfo* pState = createInfo.pDepthStencilState) {
+                writer << pState->flags << pState->depthTestEnable << pState->depthWriteEnable << pState->depthCompareOp
+                    << pState->depthBoundsTestEnable << pState->stencilTestEnable << pState->minDepthBounds << pState->maxDepthBounds;
+                writeStencilOpState(writer, pState->front);
+                writeStencilOpState(writer, pState->back);
+            }
+
+            writer << bool(createInfo.pColorBlendState);
+            if (const VkPipelineColorBlendStateCreateInfo* pState = createInfo.pColorBlendState) {
+                writer << pState->flags << pState->logicOpEnable << pState->logicOp << pState->attachmentCount;
+                for (uint32_t i = 0; i < pState->attachmentCount; i++) {
+                    const VkPipelineColorBlendAttachmentState& attachment = pState->pAttachments[i];
+                    writer << attachment.blendEnable
+                        << attachment.srcColorBlendFactor << attachment.dstColorBlendFactor << attachment.colorBlendOp
+                        << attachment.srcAlphaBlendFactor << attachment.dstAlphaBlendFactor << attachment.alphaBlendOp
+                        << attachment.colorWriteMask;
+                }
+                for (auto i : pState->blendConstants)
+                    writer << i;
+            }
+
+            writer << createInfo.layout << createInfo.renderPass << createInfo.subpass
+                << createInfo.basePipelineHandle << createInfo.basePipelineIndex;
+            return writer.get();
+        }
+        static std::string key(const VkComputePipelineCreateInfo& createInfo) {
+            KeyWriter writer;
+            writer << VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO << createInfo.flags;
+            if (!writeStage(writer, createInfo.stage))
+                return {};
+            writer << createInfo.layout << createInfo.basePipelineHandle << createInfo.basePipelineIndex;
+            return writer.get();
+        }
+
+        // Returns the pipeline built for identical create infos, or builds it. May be called from any thread.
+        result_t get(VkGraphicsPipelineCreateInfo& createInfo, VkPipeline& pipeline) {
+            return getInternal(key(createInfo), createInfo, pipeline);
+        }
+        result_t get(VkComputePipelineCreateInfo& createInfo, VkPipeline& pipeline) {
+            return getInternal(key(createInfo), createInfo, pipeline);
+        }
+
+        // The pipelines must not be in use by the GPU.
+        void clear() {
+            std::lock_guard lock(mutex);
+            entries.clear();
+            pipelinesUnkeyed.clear();
+            hitCount = missCount = 0;
+        }
+    };
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "./VKBase.h"
+
+namespace Vulkan {
+
+    // Attachments that only live within a frame's render passes, e.g. depth, MSAA color or G-buffer targets.
+    // Those used only as attachments get VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT and, where the device has it,
+    // lazily allocated memory, which tiled GPUs may never back with physical pages.
+    // Attachments share memory when their pass ranges within the frame don't overlap: each group of compatible
+    // attachments gets one allocation, in which every attachment is placed at the lowest offset not used by one
+    // alive at the same time. Aliased contents don't survive, so render passes must load them from
+    // VK_IMAGE_LAYOUT_UNDEFINED with VK_ATTACHMENT_LOAD_OP_CLEAR or _DONT_CARE.
+    // Usage: addAttachment() for each target, then create() and destroy() from the swapchain callbacks.
+    class TransientAttachmentPool {
+        struct Attachment {
+            VkFormat format;
+            VkImageUsageFlags usage;
+            VkSampleCountFlagBits samples;
+            VkImageAspectFlags aspectMask;
+            // Indices of the first and the last render pass using the attachment within a frame.
+            uint32_t firstPass;
+            uint32_t lastPass;
+            VkImage image = VK_NULL_HANDLE;
+            ImageView imageView;
+            VkMemoryRequirements memoryRequirements;
+            VkDeviceSize offset;
+        };
+        // Only attachment usages may be combined with VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT.
+        static constexpr VkImageUsageFlags attachmentUsages =
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+        std::vector<Attachment> attachments;
+        std::vector<MemoryAllocator::Allocation> allocations;
+        VkDeviceSize bytesAllocated = 0;
+        VkDeviceSize bytesWithoutAliasing = 0;
+        bool lazilyAllocated = false;
+
+        // Largest first, each at the lowest aligned offset which doesn't overlap an attachment placed before it
+        // whose pass range overlaps its own. Returns the size of the allocation.
+        static VkDeviceSize place(std::vector<Attachment*>& group) {
+            std::sort(group.begin(), group.end(),
+                [](const Attachment* a, const Attachment* b) { return a->memoryRequirements.size > b->memoryRequirements.size; });
+            VkDeviceSize size = 0;
+            std::vector<std::pair<VkDeviceSize, VkDeviceSize>> occupied;
+            for (size_t i = 0; i < group.size(); i++) {
+                Attachment& attachment = *group[i];
+                VkDeviceSize alignment = attachment.memoryRequirements.alignment;
+                occupied.clear();
+                for (size_t j = 0; j < i; j++)
+                    if (group[j]->firstPass <= attachment.lastPass &&
+                        attachment.firstPass <= group[j]->lastPass)
+                        occupied.emplace_back(group[j]->offset, group[j]->offset + group[j]->memoryRequirements.size);
+                std::sort(occupied.begin(), occupied.end());
+                VkDeviceSize offset = 0;
+                for (auto& [begin, end] : occupied)
+                    if (offset + attachment.memoryRequirements.size <= begin)
+                        break;
+                    else
+                        offset = std::max(offset, (end + alignment - 1) / alignment * alignment);
+                attachment.offset = offset;
+                size = std::max(size, offset + attachment.memoryRequirements.size);
+            }
+            return size;
+        }
+
+        static bool isTransient(VkImageUsageFlags usage) {
+            return !(usage & ~attachmentUsages);
+        }
+
+    public:
+        TransientAttachmentPool() = default;
+        TransientAttachmentPool(TransientAttachmentPool&&) = delete;
+        ~TransientAttachmentPool() { destroy(); }
+
+        VkImage getImage(uint32_t index) const { return attachments[index].image; }
+        VkImageView getImageView(uint32_t index) const { return attachments[index].imageView; }
+        // What the attachments would take without aliasing, and what they take.
+        VkDeviceSize getBytesWithoutAliasing() const { return bytesWithoutAliasing; }
+        VkDeviceSize getBytesAllocated() const { return bytesAllocated; }
+        // Whether any group got lazily allocated memory.
+        bool isLazilyAllocated() const { return lazilyAllocated; }
+
+        // Returns the index of the attachment. Takes effect with the next create().
+        uint32_t addAttachment(VkFormat format, VkImageUsageFlags usage, uint32_t firstPass, uint32_t lastPass,
+            VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT, VkImageAspectFlags aspectMask = VK_IMAGE_ASPECT_COLOR_BIT) {
+            attachments.push_back({ format, usage, samples, aspectMask, firstPass, lastPass });
+            return uint32_t(attachments.size() - 1);
+        }
+
+        result_t create(VkExtent2D extent) {
+            GraphicsBase& base = GraphicsBase::getBase();
+            MemoryAllocator& memoryAllocator = base.getMemoryAllocator();
+            bytesAllocated = bytesWithoutAliasing = 0;
+            lazilyAllocated = false;
+            for (auto& i : attachments) {
+                VkImageCreateInfo imageCreateInfo = {
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                    .imageType = VK_IMAGE_TYPE_2D,
+                    .format = i.format,
+                    .extent = { extent.width, extent.height, 1 },
+                    .mipLevels = 1,
+                    .arrayLayers = 1,
+                    .samples = i.samples,
+                    .tiling = VK_IMAGE_TILING_OPTIMAL,
+                    .usage = i.usage | (isTransient(i.usage) ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0),
+                    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+                };
+                if (VkResult result = vkCreateImage(base.getDevice(), &imageCreateInfo, HostAllocator::pCallbacks, &i.image)) {
+                    outStream << std::format("Failed to create a transient attachment!\nError code: {}", int32_t(result)) << std::endl;
+                    return result;
+                }
+                vkGetImageMemoryRequirements(base.getDevice(), i.image, &i.memoryRequirements);
+                bytesWithoutAliasing += i.memoryRequirements.size;
+            }
+
+            // Attachments alias only with ones that accept the same memory types and may use the same memory.
+            std::map<std::pair<uint32_t, bool>, std::vector<Attachment*>> groups;
+            for (auto& i : attachments)
+                groups[{ i.memoryRequirements.memoryTypeBits, isTransient(i.usage) }].push_back(&i);
+            for (auto& [key, group] : groups) {
+                auto [memoryTypeBits, transient] = key;
+                VkMemoryRequirements memoryRequirements = { place(group), 1, memoryTypeBits };
+                for (auto& i : group)
+                    memoryRequirements.alignment = std::max(memoryRequirements.alignment, i->memoryRequirements.alignment);
+                VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+                if (transient &&
+                    memoryAllocator.findMemoryTypeIndex(memoryTypeBits, properties | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != UINT32_MAX)
+                    properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT,
+                    lazilyAllocated = true;
+                // Dedicated, lazily allocated memory is committed per memory object.
+                MemoryAllocator::Allocation& allocation = allocations.emplace_back();
+                if (result_t result = memoryAllocator.allocateDedicated(memoryRequirements, properties, allocation))
+                    return result;
+                bytesAllocated += memoryRequirements.size;
+                for (auto& i : group)
+                    if (VkResult result = vkBindImageMemory(base.getDevice(), i->image, allocation.memory, allocation.offset + i->offset)) {
+                        outStream << std::format("Failed to bind memory to a transient attachment!\nError code: {}", int32_t(result)) << std::endl;
+                        return result;
+                    }
+            }
+
+            for (auto& i : attachments)
+                if (result_t result = i.imageView.create(i.image, VK_IMAGE_VIEW_TYPE_2D, i.format, { i.aspectMask, 0, 1, 0, 1 }))
+                    return result;
+            return VK_SUCCESS;
+        }
+
+        // Deferred while a swapchain is being retired, since frames still in flight may be using the attachments.
+        void destroy() {
+            struct Retired {
+                std::vector<VkImage> images;
+                std::vector<ImageView> imageViews;
+                std::vector<MemoryAllocator::Allocation> allocations;
+            };
+            auto retired = std::make_shared<Retired>();
+            for (auto& i : attachments)
+                if (i.image)
+                    retired->images.push_back(i.image),
+                    retired->imageViews.push_back(std::move(i.imageView)),
+                    i.image = VK_NULL_HANDLE;
+            retired->allocations = std::move(allocations);
+            allocations.clear();
+            if (retired->images.empty() && retired->allocations.empty())
+                return;
+            GraphicsBase::getBase().deferDestruction([retired] {
+                retired->imageViews.clear();
+                for (auto& i : retired->images)
+                    vkDestroyImage(GraphicsBase::getBase().getDevice(), i, HostAllocator::pCallbacks);
+                for (auto& i : retired->allocations)
+                    GraphicsBase::getBase().getMemoryAllocator().free(i);
+            });
+        }
+    };
+}
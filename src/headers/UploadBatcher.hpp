@@ -0,0 +1,212 @@
+#pragma once
+
+#include "./VKBase.h"
+
+namespace Vulkan {
+
+    // Collects uploads to buffers and images through staging memory and sends them to the transfer queue in one
+    // command buffer per submit(), which is meant to be called once per frame. With a dedicated transfer family,
+    // destinations are released to the graphics family there; the graphics side acquires them with cmdAcquire(),
+    // which also yields the transfer timeline wait, so a graphics submission only waits when it consumes new data.
+    // Destinations must be VK_SHARING_MODE_EXCLUSIVE and must not be in use by the graphics queue until acquired.
+    class UploadBatcher {
+        struct BufferCopy {
+            VkBuffer staging;
+            VkBuffer buffer;
+            VkBufferCopy region;
+        };
+        struct ImageCopy {
+            VkBuffer staging;
+            VkImage image;
+            VkBufferImageCopy region;
+            VkImageLayout finalLayout;
+        };
+        struct Slot {
+            CommandBuffer commandBuffer;
+            uint64_t timelineValue = 0;
+            // Freed once the timeline value is reached.
+            std::vector<Buffer> stagings;
+        };
+
+        CommandPool commandPool;
+        std::vector<Slot> slots;
+        uint32_t submitCount = 0;
+        std::vector<Buffer> pendingStagings;
+        std::vector<BufferCopy> pendingBufferCopies;
+        std::vector<ImageCopy> pendingImageCopies;
+        // Barriers the graphics queue has to record, matching the released ones, and the value to wait for.
+        std::vector<VkBufferMemoryBarrier> acquireBufferBarriers;
+        std::vector<VkImageMemoryBarrier> acquireImageBarriers;
+        uint64_t acquireTimelineValue = 0;
+        std::vector<VkBufferMemoryBarrier> bufferBarriers;
+        std::vector<VkImageMemoryBarrier> imageBarriers;
+        VkDeviceSize bytesPending = 0;
+
+        static bool isOwnershipTransferred() {
+            return GraphicsBase::getBase().getQueueFamilyIndexTransfer() != GraphicsBase::getBase().getQueueFamilyIndexGraphics();
+        }
+
+        result_t createStaging(const void* pData, VkDeviceSize size, VkBuffer& buffer) {
+            Buffer& staging = pendingStagings.emplace_back();
+            if (result_t result = staging.create(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+                return result;
+            memcpy(staging.pMappedData(), pData, size_t(size));
+            buffer = staging;
+            bytesPending += size;
+            return VK_SUCCESS;
+        }
+
+        void recordCopies(VkCommandBuffer commandBuffer) {
+            bool transferred = isOwnershipTransferred();
+            uint32_t queueFamilyIndexTransfer = GraphicsBase::getBase().getQueueFamilyIndexTransfer();
+            uint32_t queueFamilyIndexGraphics = GraphicsBase::getBase().getQueueFamilyIndexGraphics();
+
+            imageBarriers.clear();
+            for (auto& i : pendingImageCopies)
+                imageBarriers.push_back({
+                    .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                    .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                    .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+                    .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                    .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                    .image = i.image,
+                    .subresourceRange = { i.region.imageSubresource.aspectMask, i.region.imageSubresource.mipLevel, 1,
+                        i.region.imageSubresource.baseArrayLayer, i.region.imageSubresource.layerCount }
+                });
+            if (imageBarriers.size())
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                    0, nullptr, 0, nullptr, uint32_t(imageBarriers.size()), imageBarriers.data());
+
+            for (auto& i : pendingBufferCopies)
+                vkCmdCopyBuffer(commandBuffer, i.staging, i.buffer, 1, &i.region);
+            for (auto& i : pendingImageCopies)
+                vkCmdCopyBufferToImage(commandBuffer, i.staging, i.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &i.region);
+
+            // Releases to the graphics family, or without a transfer of ownership, makes the writes available and
+            // transitions images to their final layouts; the semaphore wait on the graphics side does the rest.
+            bufferBarriers.clear();
+            for (auto& i : pendingBufferCopies)
+                bufferBarriers.push_back({
+                    .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                    .srcQueueFamilyIndex = transferred ? queueFamilyIndexTransfer : VK_QUEUE_FAMILY_IGNORED,
+                    .dstQueueFamilyIndex = transferred ? queueFamilyIndexGraphics : VK_QUEUE_FAMILY_IGNORED,
+                    .buffer = i.buffer,
+                    .offset = i.region.dstOffset,
+                    .size = i.region.size
+                });
+            for (auto& i : imageBarriers)
+                i.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                i.dstAccessMask = 0,
+                i.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                i.srcQueueFamilyIndex = transferred ? queueFamilyIndexTransfer : VK_QUEUE_FAMILY_IGNORED,
+                i.dstQueueFamilyIndex = transferred ? queueFamilyIndexGraphics : VK_QUEUE_FAMILY_IGNORED;
+            for (size_t i = 0; i < imageBarriers.size(); i++)
+                imageBarriers[i].newLayout = pendingImageCopies[i].finalLayout;
+            vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                0, nullptr, uint32_t(bufferBarriers.size()), bufferBarriers.data(), uint32_t(imageBarriers.size()), imageBarriers.data());
+
+            if (!transferred)
+                return;
+            for (auto& i : bufferBarriers)
+                i.srcAccessMask = 0,
+                i.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            for (auto& i : imageBarriers)
+                i.srcAccessMask = 0,
+                i.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            acquireBufferBarriers.insert(acquireBufferBarriers.end(), bufferBarriers.begin(), bufferBarriers.end());
+            acquireImageBarriers.insert(acquireImageBarriers.end(), imageBarriers.begin(), imageBarriers.end());
+        }
+
+    public:
+        UploadBatcher() = default;
+        UploadBatcher(UploadBatcher&&) = delete;
+        ~UploadBatcher() { destroy(); }
+
+        // Bytes staged since the last submit().
+        VkDeviceSize getBytesPending() const { return bytesPending; }
+
+        result_t create(uint32_t slotCount = GraphicsBase::getBase().getMaxFramesInFlight()) {
+            if (result_t result = commandPool.create(GraphicsBase::getBase().getQueueFamilyIndexTransfer(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT))
+                return result;
+            slots.resize(slotCount);
+            for (auto& i : slots)
+                if (result_t result = commandPool.allocateBuffers(i.commandBuffer))
+                    return result;
+            return VK_SUCCESS;
+        }
+
+        result_t uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void* pData, VkDeviceSize size) {
+            VkBuffer staging;
+            if (result_t result = createStaging(pData, size, staging))
+                return result;
+            pendingBufferCopies.push_back({ staging, buffer, { 0, offset, size } });
+            return VK_SUCCESS;
+        }
+        // Replaces the whole contents of the region's subresource, which ends up in finalLayout.
+        // Extents on a transfer-only family must respect its minImageTransferGranularity, whole mip levels always do.
+        result_t uploadImage(VkImage image, const VkBufferImageCopy& region, const void* pData, VkDeviceSize size,
+            VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+            VkBuffer staging;
+            if (result_t result = createStaging(pData, size, staging))
+                return result;
+            ImageCopy& imageCopy = pendingImageCopies.emplace_back(ImageCopy{ staging, image, region, finalLayout });
+            imageCopy.region.bufferOffset = 0;
+            return VK_SUCCESS;
+        }
+
+        // Records and submits everything uploaded since the last call on the transfer timeline, without waiting
+        // on the graphics queue. Does nothing if nothing was uploaded.
+        result_t submit() {
+            if (pendingBufferCopies.empty() && pendingImageCopies.empty())
+                return VK_SUCCESS;
+            GraphicsBase& base = GraphicsBase::getBase();
+            Slot& slot = slots[submitCount % slots.size()];
+            if (result_t result = base.waitTimeline(GraphicsBase::timelineTransfer, slot.timelineValue))
+                return result;
+            slot.stagings.clear();
+
+            if (result_t result = slot.commandBuffer.begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT))
+                return result;
+            recordCopies(slot.commandBuffer);
+            if (result_t result = slot.commandBuffer.end())
+                return result;
+            if (result_t result = base.submitTimelined(GraphicsBase::timelineTransfer, slot.commandBuffer, {},
+                VK_NULL_HANDLE, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_NULL_HANDLE, &slot.timelineValue))
+                return result;
+            acquireTimelineValue = slot.timelineValue;
+            std::swap(slot.stagings, pendingStagings);
+            pendingBufferCopies.clear();
+            pendingImageCopies.clear();
+            bytesPending = 0;
+            submitCount++;
+            return VK_SUCCESS;
+        }
+
+        // Call while recording the first graphics command buffer that reads uploaded data, outside of render passes.
+        // Acquires everything submitted and not yet acquired, and appends the wait that submission needs.
+        void cmdAcquire(VkCommandBuffer commandBuffer, std::vector<GraphicsBase::TimelineWait>& timelineWaits) {
+            if (!acquireTimelineValue)
+                return;
+            timelineWaits.push_back({ GraphicsBase::timelineTransfer, acquireTimelineValue });
+            acquireTimelineValue = 0;
+            if (acquireBufferBarriers.size() || acquireImageBarriers.size())
+                vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                    0, nullptr, uint32_t(acquireBufferBarriers.size()), acquireBufferBarriers.data(),
+                    uint32_t(acquireImageBarriers.size()), acquireImageBarriers.data());
+            acquireBufferBarriers.clear();
+            acquireImageBarriers.clear();
+        }
+
+        // The queues must be done with the uploads, e.g. after GraphicsBase::waitIdle().
+        void destroy() {
+            for (auto& i : slots)
+                i.stagings.clear();
+            pendingStagings.clear();
+            pendingBufferCopies.clear();
+            pendingImageCopies.clear();
+        }
+    };
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "./VKBase.h"
+
+namespace Vulkan {
+
+    // A host-visible, persistently mapped buffer with one region per frame in flight, for data written every frame
+    // (uniforms, instance data, streamed vertices). Allocation bumps an offset within the current frame's region,
+    // which the GPU is done with once the frame slot's previous submission has been waited for, so uploads never
+    // allocate or map memory. Non-coherent memory is flushed once per frame, over everything written.
+    class UploadRing {
+    public:
+        struct Range {
+            VkBuffer buffer = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            VkDeviceSize size = 0;
+            // Null if the region of the frame is full.
+            void* pData = nullptr;
+            explicit operator bool() const { return pData; }
+        };
+
+    private:
+        Buffer buffer;
+        bool coherent = true;
+        VkDeviceSize nonCoherentAtomSize = 1;
+        VkDeviceSize defaultAlignment = 1;
+        VkDeviceSize regionSize = 0;
+        uint32_t regionCount = 0;
+        uint32_t currentRegion = 0;
+        // Offsets within the current region.
+        VkDeviceSize head = 0;
+        VkDeviceSize flushedHead = 0;
+        VkDeviceSize highWater = 0;
+        bool overflowReported = false;
+
+    public:
+        UploadRing() = default;
+        UploadRing(VkDeviceSize sizePerFrame, VkBufferUsageFlags usage = 0) { create(sizePerFrame, usage); }
+        UploadRing(UploadRing&&) = delete;
+
+        VkBuffer getBuffer() const { return buffer; }
+        VkDeviceSize getRegionSize() const { return regionSize; }
+        // The most bytes used by a frame so far, to size the regions by.
+        VkDeviceSize getHighWater() const { return highWater; }
+
+        // Call once the frame slot's previous submission has been waited for, before the first allocation of the frame.
+        void beginFrame() {
+            currentRegion = GraphicsBase::getBase().getCurrentFrameIndex() % regionCount;
+            head = flushedHead = 0;
+        }
+
+        // alignment defaults to the larger of minUniformBufferOffsetAlignment and minStorageBufferOffsetAlignment.
+        Range allocate(VkDeviceSize size, VkDeviceSize alignment = 0) {
+            if (!alignment)
+                alignment = defaultAlignment;
+            VkDeviceSize offset = (head + alignment - 1) / alignment * alignment;
+            if (offset + size > regionSize) {
+                if (!overflowReported)
+                    outStream << std::format("The upload ring is out of space, {} bytes per frame aren't enough.", regionSize) << std::endl,
+                    overflowReported = true;
+                return {};
+            }
+            head = offset + size;
+            highWater = std::max(highWater, head);
+            offset += currentRegion * regionSize;
+            return { buffer, offset, size, static_cast<uint8_t*>(buffer.pMappedData()) + offset };
+        }
+        Range upload(const void* pData, VkDeviceSize size, VkDeviceSize alignment = 0) {
+            Range range = allocate(size, alignment);
+            if (range)
+                memcpy(range.pData, pData, size_t(size));
+            return range;
+        }
+        template<typename T>
+        Range upload(const T& data, VkDeviceSize alignment = 0) {
+            return upload(&data, sizeof data, alignment);
+        }
+
+        // Call before submitting the command buffers that read the frame's data. Does nothing for coherent memory.
+        result_t flush() {
+            if (coherent || head == flushedHead)
+                return VK_SUCCESS;
+            // Regions are multiples of nonCoherentAtomSize, so rounding never leaves the region.
+            VkDeviceSize begin = flushedHead / nonCoherentAtomSize * nonCoherentAtomSize;
+            VkDeviceSize end = std::min((head + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize, regionSize);
+            VkMappedMemoryRange mappedMemoryRange = {
+                .sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+                .memory = buffer.getAllocation().memory,
+                .offset = buffer.getAllocation().offset + currentRegion * regionSize + begin,
+                .size = end - begin
+            };
+            VkResult result = vkFlushMappedMemoryRanges(GraphicsBase::getBase().getDevice(), 1, &mappedMemoryRange);
+            if (result)
+                outStream << std::format("Failed to flush the upload ring!\nError code: {}", int32_t(result)) << std::endl;
+            else
+                flushedHead = head;
+            return result;
+        }
+
+        // usage defaults to uniform, storage, vertex, index and transfer source.
+        result_t create(VkDeviceSize sizePerFrame, VkBufferUsageFlags usage = 0) {
+            GraphicsBase& base = GraphicsBase::getBase();
+            const VkPhysicalDeviceLimits& limits = base.getPhysicalDeviceProperties().limits;
+            defaultAlignment = std::max(limits.minUniformBufferOffsetAlignment, limits.minStorageBufferOffsetAlignment);
+            nonCoherentAtomSize = limits.nonCoherentAtomSize;
+            regionCount = base.getMaxFramesInFlight();
+            regionSize = (sizePerFrame + nonCoherentAtomSize - 1) / nonCoherentAtomSize * nonCoherentAtomSize;
+            VkBufferUsageFlags bufferUsage = usage ? usage :
+                VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+            // Coherent memory needs no flushes, other host-visible memory is the fallback.
+            coherent = !buffer.create(regionSize * regionCount, bufferUsage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            if (!coherent) {
+                buffer.~Buffer();
+                if (result_t result = buffer.create(regionSize * regionCount, bufferUsage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+                    return result;
+            }
+            return VK_SUCCESS;
+        }
+    };
+}
@@ -7,12 +7,837 @@ namespace Vulkan {
 
     constexpr VkExtent2D defaultWindowSize = { 1600, 900 };
 
+    template<typename T>
+    class ArrayRef {
+        T* const pArray = nullptr;
+        size_t count = 0;
+    public:
+        // 从空参数构造，count为0
+        ArrayRef() = default;
+        // 从单个对象构造，count为1
+        ArrayRef(T& data) :pArray(&data), count(1) {}
+        // 从顶级数组构造
+        template<size_t elementCount>
+        ArrayRef(T(&data)[elementCount]) : pArray(data), count(elementCount) {}
+        // 从指针和元素个数构造
+        ArrayRef(T* pData, size_t elementCount) :pArray(pData), count(elementCount) {}
+        // 复制构造，若T带const修饰，兼容从对应的无const修饰版本的arrayRef构造
+        // 24.01.07 修正因复制粘贴产生的typo：从pArray(&other)改为pArray(other.Pointer())
+        ArrayRef(const ArrayRef<std::remove_const_t<T>>& other) :pArray(other.pointer()), count(other.getCount()) {}
+        // Getter
+        T* pointer() const { return pArray; }
+        size_t getCount() const { return count; }
+        // Const Function
+        T& operator[](size_t index) const { return pArray[index]; }
+        T* begin() const { return pArray; }
+        T* end() const { return pArray + count; }
+        // Non-const Function
+        // 禁止复制/移动赋值
+        ArrayRef& operator=(const ArrayRef&) = delete;
+    };
+
+    // Host memory the driver allocates for Vulkan objects. pCallbacks is the pAllocator of every creation and
+    // destruction in the wrappers, null by default, which leaves it to the driver. usePools() points it at pooled
+    // callbacks: blocks of up to maxPooledSize bytes come from per-size-class free lists carved out of slabs, so the
+    // many small allocations of object creation and command recording rarely reach the system allocator.
+    // Set it before createInstance() and leave it until the instance is destroyed, since objects must be destroyed
+    // with callbacks compatible with those they were created with.
+    class HostAllocator {
+    public:
+        struct Statistics {
+            // Bytes requested through the callbacks and not yet freed, and the most at once.
+            std::atomic<size_t> bytes;
+            std::atomic<size_t> peakBytes;
+            std::atomic<uint64_t> allocationCount;
+            // Allocated by the driver itself and reported through pfnInternalAllocation, e.g. executable memory.
+            std::atomic<size_t> internalBytes;
+        };
+        static constexpr size_t maxPooledSize = 4096;
+
+    private:
+        static constexpr uint32_t minSizeClassShift = 5;
+        static constexpr uint32_t sizeClassCount = std::bit_width(maxPooledSize) - minSizeClassShift;
+        static constexpr size_t slabSize = 64 << 10;
+        // Precedes the pointer returned to the driver.
+        struct Header {
+            // sizeClassCount for blocks from the system allocator.
+            uint32_t sizeClass;
+            uint32_t scope;
+            // Of the pointer from the start of the block.
+            size_t offset;
+            size_t size;
+        };
+        // Slabs are never returned to the system, the driver may free into them until the instance is destroyed,
+        // which can happen during static destruction.
+        struct SizeClass {
+            std::mutex mutex;
+            void* pFreeList;
+        };
+        // Zero-initialized, as statics.
+        inline static SizeClass sizeClasses[sizeClassCount];
+        inline static Statistics statistics[VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1];
+        inline static std::atomic<size_t> slabBytes = 0;
+        inline static std::atomic<uint64_t> systemAllocationCount = 0;
+
+        static uint32_t sizeClassOf(size_t blockSize) {
+            if (blockSize > maxPooledSize)
+                return sizeClassCount;
+            return uint32_t(std::bit_width(std::max(blockSize, size_t(1) << minSizeClassShift) - 1)) - minSizeClassShift;
+        }
+        static size_t slotSizeOf(uint32_t sizeClass) {
+            return size_t(1) << (sizeClass + minSizeClassShift);
+        }
+        static void* allocateSlot(uint32_t sizeClass) {
+            SizeClass& pool = sizeClasses[sizeClass];
+            std::lock_guard lock(pool.mutex);
+            if (!pool.pFreeList) {
+                uint8_t* pSlab = static_cast<uint8_t*>(::operator new(slabSize, std::nothrow));
+                if (!pSlab)
+                    return nullptr;
+                systemAllocationCount++;
+                slabBytes += slabSize;
+                for (size_t offset = slabSize; offset;) {
+                    offset -= slotSizeOf(sizeClass);
+                    *reinterpret_cast<void**>(pSlab + offset) = pool.pFreeList;
+                    pool.pFreeList = pSlab + offset;
+                }
+            }
+            void* pSlot = pool.pFreeList;
+            pool.pFreeList = *static_cast<void**>(pSlot);
+            return pSlot;
+        }
+        static void count(VkSystemAllocationScope scope, size_t size) {
+            Statistics& scopeStatistics = statistics[scope];
+            size_t bytes = scopeStatistics.bytes += size;
+            size_t peakBytes = scopeStatistics.peakBytes;
+            while (bytes > peakBytes &&
+                !scopeStatistics.peakBytes.compare_exchange_weak(peakBytes, bytes));
+            scopeStatistics.allocationCount++;
+        }
+
+        static void* VKAPI_CALL allocate(void*, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+            alignment = std::max(alignment, alignof(std::max_align_t));
+            size_t blockSize = size + sizeof(Header) + alignment - 1;
+            uint32_t sizeClass = sizeClassOf(blockSize);
+            void* pBlock = nullptr;
+            if (sizeClass < sizeClassCount)
+                pBlock = allocateSlot(sizeClass);
+            else if ((pBlock = ::operator new(blockSize, std::nothrow)))
+                systemAllocationCount++;
+            if (!pBlock)
+                return nullptr;
+            uintptr_t address = (reinterpret_cast<uintptr_t>(pBlock) + sizeof(Header) + alignment - 1) & ~uintptr_t(alignment - 1);
+            reinterpret_cast<Header*>(address)[-1] = { sizeClass, uint32_t(scope), address - reinterpret_cast<uintptr_t>(pBlock), size };
+            count(scope, size);
+            return reinterpret_cast<void*>(address);
+        }
+        static void VKAPI_CALL free(void*, void* pMemory) {
+            if (!pMemory)
+                return;
+            Header& header = static_cast<Header*>(pMemory)[-1];
+            statistics[header.scope].bytes -= header.size;
+            void* pBlock = static_cast<uint8_t*>(pMemory) - header.offset;
+            if (header.sizeClass == sizeClassCount) {
+                ::operator delete(pBlock);
+                return;
+            }
+            SizeClass& pool = sizeClasses[header.sizeClass];
+            std::lock_guard lock(pool.mutex);
+            *static_cast<void**>(pBlock) = pool.pFreeList;
+            pool.pFreeList = pBlock;
+        }
+        // Grows or shrinks in place while the size still fits the slot, as long as the alignment holds.
+        static void* VKAPI_CALL reallocate(void*, void* pOriginal, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+            if (!pOriginal)
+                return allocate(nullptr, size, alignment, scope);
+            if (!size)
+                return free(nullptr, pOriginal), nullptr;
+            Header& header = static_cast<Header*>(pOriginal)[-1];
+            if (header.sizeClass < sizeClassCount &&
+                !(reinterpret_cast<uintptr_t>(pOriginal) & (alignment - 1)) &&
+                header.offset + size <= slotSizeOf(header.sizeClass)) {
+                statistics[header.scope].bytes -= header.size;
+                count(VkSystemAllocationScope(header.scope), size);
+                header.size = size;
+                return pOriginal;
+            }
+            void* pMemory = allocate(nullptr, size, alignment, scope);
+            if (!pMemory)
+                return nullptr;
+            memcpy(pMemory, pOriginal, std::min(size, header.size));
+            free(nullptr, pOriginal);
+            return pMemory;
+        }
+        static void VKAPI_CALL internalAllocationNotification(void*, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope) {
+            statistics[scope].internalBytes += size;
+        }
+        static void VKAPI_CALL internalFreeNotification(void*, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope) {
+            statistics[scope].internalBytes -= size;
+        }
+
+        inline static const VkAllocationCallbacks pooledCallbacks = {
+            .pfnAllocation = allocate,
+            .pfnReallocation = reallocate,
+            .pfnFree = free,
+            .pfnInternalAllocation = internalAllocationNotification,
+            .pfnInternalFree = internalFreeNotification
+        };
+
+    public:
+        // May also point at callbacks of the application's own.
+        inline static const VkAllocationCallbacks* pCallbacks = nullptr;
+
+        static void usePools() { pCallbacks = &pooledCallbacks; }
+        // Only counted with the pooled callbacks.
+        static const Statistics& getStatistics(VkSystemAllocationScope scope) { return statistics[scope]; }
+        // Bytes of the slabs, and the times the system allocator was called, for slabs or for blocks too large to pool.
+        static size_t getSlabBytes() { return slabBytes; }
+        static uint64_t getSystemAllocationCount() { return systemAllocationCount; }
+    };
+
+    // Recycles fences and binary semaphores so that steady-state frames create no sync objects.
+    // Fences are reset when they are returned; semaphores must come back unsignaled with no pending wait.
+    class SyncObjectPool {
+    public:
+        struct Statistics {
+            uint32_t fencesCreated = 0;
+            uint32_t semaphoresCreated = 0;
+            uint32_t fencesInUse = 0;
+            uint32_t semaphoresInUse = 0;
+            uint32_t fencesHighWater = 0;
+            uint32_t semaphoresHighWater = 0;
+            uint32_t creationsThisFrame = 0;
+            uint32_t creationsLastFrame = 0;
+        };
+
+    private:
+        VkDevice device = VK_NULL_HANDLE;
+        std::vector<VkFence> freeFences;
+        std::vector<VkSemaphore> freeSemaphores;
+        Statistics statistics;
+
+    public:
+        const Statistics& getStatistics() const { return statistics; }
+
+        void setDevice(VkDevice device) {
+            this->device = device;
+        }
+
+        void newFrame() {
+            statistics.creationsLastFrame = statistics.creationsThisFrame;
+            statistics.creationsThisFrame = 0;
+        }
+
+        result_t acquireFence(VkFence& fence) {
+            if (freeFences.size()) {
+                fence = freeFences.back();
+                freeFences.pop_back();
+            } else {
+                VkFenceCreateInfo createInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+                if (VkResult result = vkCreateFence(device, &createInfo, HostAllocator::pCallbacks, &fence)) {
+                    outStream << std::format("Failed to create a pooled fence!\nError code: {}", int32_t(result)) << std::endl;
+                    return result;
+                }
+                statistics.fencesCreated++;
+                statistics.creationsThisFrame++;
+            }
+            statistics.fencesHighWater = std::max(statistics.fencesHighWater, ++statistics.fencesInUse);
+            return VK_SUCCESS;
+        }
+
+        // The fence must not be associated with a pending queue submission.
+        result_t recycleFence(VkFence fence) {
+            if (VkResult result = vkResetFences(device, 1, &fence)) {
+                outStream << std::format("Failed to reset a pooled fence!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            freeFences.push_back(fence);
+            statistics.fencesInUse--;
+            return VK_SUCCESS;
+        }
+
+        result_t acquireSemaphore(VkSemaphore& semaphore) {
+            if (freeSemaphores.size()) {
+                semaphore = freeSemaphores.back();
+                freeSemaphores.pop_back();
+            } else {
+                VkSemaphoreCreateInfo createInfo = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+                if (VkResult result = vkCreateSemaphore(device, &createInfo, HostAllocator::pCallbacks, &semaphore)) {
+                    outStream << std::format("Failed to create a pooled semaphore!\nError code: {}", int32_t(result)) << std::endl;
+                    return result;
+                }
+                statistics.semaphoresCreated++;
+                statistics.creationsThisFrame++;
+            }
+            statistics.semaphoresHighWater = std::max(statistics.semaphoresHighWater, ++statistics.semaphoresInUse);
+            return VK_SUCCESS;
+        }
+
+        void recycleSemaphore(VkSemaphore semaphore) {
+            freeSemaphores.push_back(semaphore);
+            statistics.semaphoresInUse--;
+        }
+
+        // Objects still held by users are not tracked and must be returned before this is called.
+        void destroy() {
+            for (auto& i : freeFences)
+                vkDestroyFence(device, i, HostAllocator::pCallbacks);
+            for (auto& i : freeSemaphores)
+                vkDestroySemaphore(device, i, HostAllocator::pCallbacks);
+            freeFences.resize(0);
+            freeSemaphores.resize(0);
+            statistics = {};
+        }
+    };
+
+    // Sub-allocates large VkDeviceMemory blocks, kept per memory type and each managed as a buddy allocator, so that
+    // resources don't each cost a driver allocation and maxMemoryAllocationCount stays out of reach.
+    // Node offsets are aligned to their power-of-two sizes, which covers any alignment the requirements ask for.
+    // If bufferImageGranularity exceeds the smallest node, linear resources (buffers, linear images) and optimal images
+    // are kept in separate blocks, so that they never share a granularity page. Resources of more than half a block
+    // get a dedicated allocation. Host-visible memory is persistently mapped.
+    // Allocations that would take a heap past its budget (from VK_EXT_memory_budget, else 80% of the heap) are first
+    // offered to callbackOverBudget, which may evict streaming resources, then refused, so that the next memory type
+    // is tried instead of letting the driver page.
+    class MemoryAllocator {
+    public:
+        struct Allocation {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkDeviceSize offset = 0;
+            // The size of the buddy node, the requested size rounded up to a power of two, or the requested size if dedicated.
+            VkDeviceSize size = 0;
+            uint32_t memoryTypeIndex = UINT32_MAX;
+            // Null unless the memory is host-visible, points to offset otherwise.
+            void* pMappedData = nullptr;
+            // Null for dedicated allocations.
+            void* pBlock = nullptr;
+            bool isDedicated() const { return memory && !pBlock; }
+            explicit operator bool() const { return memory; }
+        };
+        struct HeapStatistics {
+            uint32_t blockCount = 0;
+            VkDeviceSize blockBytes = 0;
+            uint32_t allocationCount = 0;
+            VkDeviceSize allocatedBytes = 0;
+            uint32_t dedicatedAllocationCount = 0;
+            VkDeviceSize dedicatedBytes = 0;
+        };
+        struct HeapBudget {
+            // Bytes the process can allocate from the heap without degrading performance.
+            VkDeviceSize budget = 0;
+            // Bytes the process uses, as of the last updateBudget() plus what this allocator allocated since.
+            VkDeviceSize usage = 0;
+        };
+        static constexpr VkDeviceSize minNodeSize = 256;
+        // Called with the heap and the bytes over budget, returns true if it freed memory of the heap.
+        // Resources the GPU may still be using must be deferred, their memory then only counts from the next updateBudget().
+        inline static bool(*callbackOverBudget)(uint32_t heapIndex, VkDeviceSize bytesOverBudget) = nullptr;
+        static constexpr VkDeviceSize defaultBlockSize = 64 << 20;
+
+    private:
+        struct Block {
+            VkDeviceMemory memory;
+            VkDeviceSize size;
+            void* pMappedData;
+            bool linear;
+            uint32_t allocationCount = 0;
+            // Offsets of the free nodes of each level, level 0 being the whole block and level n having nodes of size >> n.
+            std::vector<std::set<VkDeviceSize>> freeNodes;
+        };
+
+        VkDevice device = VK_NULL_HANDLE;
+        VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+        VkPhysicalDeviceMemoryProperties memoryProperties = {};
+        VkDeviceSize bufferImageGranularity = 1;
+        uint32_t maxAllocationCount = 4096;
+        uint32_t deviceAllocationCount = 0;
+        std::vector<std::unique_ptr<Block>> blocks[VK_MAX_MEMORY_TYPES];
+        HeapStatistics heapStatistics[VK_MAX_MEMORY_HEAPS];
+        // Masks of the memory types which have all of the properties, keyed by memoryTypeBits << 32 | properties.
+        // Resources of one kind keep asking for the same pair, so the memory types are scanned once per pair.
+        std::unordered_map<uint64_t, uint32_t> memoryTypeMasks;
+        HeapBudget heapBudgets[VK_MAX_MEMORY_HEAPS];
+        bool memoryBudgetEnabled = false;
+        // Resources may be created from worker threads, e.g. while loading. Recursive, since callbackOverBudget frees.
+        mutable std::recursive_mutex mutex;
+
+        HeapStatistics& heapStatisticsOf(uint32_t memoryTypeIndex) {
+            return heapStatistics[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+        }
+        // A power of two; an eighth of heaps up to 1 GiB, which are typically the small host-visible device-local ones.
+        VkDeviceSize blockSizeOf(uint32_t memoryTypeIndex) const {
+            VkDeviceSize heapSize = memoryProperties.memoryHeaps[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex].size;
+            if (heapSize > 1ull << 30)
+                return defaultBlockSize;
+            return std::max(std::bit_floor(heapSize / 8), minNodeSize);
+        }
+
+        VkResult allocateMemory(const VkMemoryAllocateInfo& allocateInfo, VkDeviceMemory& memory, void*& pMappedData) {
+            if (deviceAllocationCount == maxAllocationCount) {
+                outStream << std::format("Failed to allocate device memory!\nmaxMemoryAllocationCount ({}) is reached.", maxAllocationCount) << std::endl;
+                return VK_ERROR_TOO_MANY_OBJECTS;
+            }
+            uint32_t heapIndex = memoryProperties.memoryTypes[allocateInfo.memoryTypeIndex].heapIndex;
+            HeapBudget& heapBudget = heapBudgets[heapIndex];
+            if (heapBudget.usage + allocateInfo.allocationSize > heapBudget.budget &&
+                !(callbackOverBudget && callbackOverBudget(heapIndex, heapBudget.usage + allocateInfo.allocationSize - heapBudget.budget) &&
+                    heapBudget.usage + allocateInfo.allocationSize <= heapBudget.budget)) {
+                outStream << std::format("Refused to allocate {} bytes from memory heap {}, {} of its budget of {} bytes are in use.",
+                    allocateInfo.allocationSize, heapIndex, heapBudget.usage, heapBudget.budget) << std::endl;
+                return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+            }
+            if (VkResult result = vkAllocateMemory(device, &allocateInfo, HostAllocator::pCallbacks, &memory)) {
+                outStream << std::format("Failed to allocate device memory!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            pMappedData = nullptr;
+            if (memoryProperties.memoryTypes[allocateInfo.memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+                if (VkResult result = vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &pMappedData)) {
+                    outStream << std::format("Failed to map device memory!\nError code: {}", int32_t(result)) << std::endl;
+                    vkFreeMemory(device, memory, HostAllocator::pCallbacks);
+                    return result;
+                }
+            deviceAllocationCount++;
+            heapBudget.usage += allocateInfo.allocationSize;
+            return VK_SUCCESS;
+        }
+        void freeMemory(VkDeviceMemory memory, uint32_t memoryTypeIndex, VkDeviceSize size) {
+            vkFreeMemory(device, memory, HostAllocator::pCallbacks);
+            deviceAllocationCount--;
+            HeapBudget& heapBudget = heapBudgets[memoryProperties.memoryTypes[memoryTypeIndex].heapIndex];
+            heapBudget.usage -= std::min(heapBudget.usage, size);
+        }
+
+        VkResult createBlock(uint32_t memoryTypeIndex, bool linear, Block*& pBlock) {
+            VkDeviceSize size = blockSizeOf(memoryTypeIndex);
+            VkMemoryAllocateInfo allocateInfo = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                .allocationSize = size,
+                .memoryTypeIndex = memoryTypeIndex
+            };
+            VkDeviceMemory memory;
+            void* pMappedData;
+            if (VkResult result = allocateMemory(allocateInfo, memory, pMappedData))
+                return result;
+            pBlock = blocks[memoryTypeIndex].emplace_back(std::make_unique<Block>(Block{ memory, size, pMappedData, linear })).get();
+            pBlock->freeNodes.resize(std::countr_zero(size / minNodeSize) + 1);
+            pBlock->freeNodes[0].insert(0);
+            HeapStatistics& statistics = heapStatisticsOf(memoryTypeIndex);
+            statistics.blockCount++;
+            statistics.blockBytes += size;
+            return VK_SUCCESS;
+        }
+        void destroyBlock(uint32_t memoryTypeIndex, Block* pBlock) {
+            HeapStatistics& statistics = heapStatisticsOf(memoryTypeIndex);
+            statistics.blockCount--;
+            statistics.blockBytes -= pBlock->size;
+            freeMemory(pBlock->memory, memoryTypeIndex, pBlock->size);
+            auto& blocksOfType = blocks[memoryTypeIndex];
+            blocksOfType.erase(std::find_if(blocksOfType.begin(), blocksOfType.end(), [pBlock](auto& i) { return i.get() == pBlock; }));
+        }
+
+        // Takes the first free node of the level, splitting a larger one if there is none.
+        static bool allocateNode(Block& block, VkDeviceSize nodeSize, VkDeviceSize& offset) {
+            uint32_t level = std::countr_zero(block.size / nodeSize);
+            uint32_t i = level;
+            while (block.freeNodes[i].empty())
+                if (!i--)
+                    return false;
+            offset = *block.freeNodes[i].begin();
+            block.freeNodes[i].erase(block.freeNodes[i].begin());
+            // Keeps the lower half of each split, the upper half becomes a free node one level down.
+            for (; i < level; i++)
+                block.freeNodes[i + 1].insert(offset + (block.size >> (i + 1)));
+            block.allocationCount++;
+            return true;
+        }
+        // Merges the node with its buddy for as long as the buddy is free.
+        static void freeNode(Block& block, VkDeviceSize nodeSize, VkDeviceSize offset) {
+            uint32_t level = std::countr_zero(block.size / nodeSize);
+            for (; level; level--) {
+                auto buddy = block.freeNodes[level].find(offset ^ block.size >> level);
+                if (buddy == block.freeNodes[level].end())
+                    break;
+                offset = std::min(offset, *buddy);
+                block.freeNodes[level].erase(buddy);
+            }
+            block.freeNodes[level].insert(offset);
+            block.allocationCount--;
+        }
+
+        VkResult allocateDedicatedInternal(const VkMemoryRequirements& requirements, uint32_t memoryTypeIndex, Allocation& allocation,
+            VkBuffer buffer, VkImage image) {
+            VkMemoryDedicatedAllocateInfo dedicatedAllocateInfo = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO,
+                .image = image,
+                .buffer = buffer
+            };
+            VkMemoryAllocateInfo allocateInfo = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                .pNext = buffer || image ? &dedicatedAllocateInfo : nullptr,
+                .allocationSize = requirements.size,
+                .memoryTypeIndex = memoryTypeIndex
+            };
+            allocation = { .size = requirements.size, .memoryTypeIndex = memoryTypeIndex };
+            if (VkResult result = allocateMemory(allocateInfo, allocation.memory, allocation.pMappedData))
+                return result;
+            HeapStatistics& statistics = heapStatisticsOf(memoryTypeIndex);
+            statistics.dedicatedAllocationCount++;
+            statistics.dedicatedBytes += requirements.size;
+            return VK_SUCCESS;
+        }
+
+        uint32_t memoryTypeMask(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties) {
+            auto [i, inserted] = memoryTypeMasks.try_emplace(uint64_t(memoryTypeBits) << 32 | properties, 0);
+            if (inserted)
+                for (uint32_t j = 0; j < memoryProperties.memoryTypeCount; j++)
+                    if (memoryTypeBits & 1 << j &&
+                        (memoryProperties.memoryTypes[j].propertyFlags & properties) == properties)
+                        i->second |= 1 << j;
+            return i->second;
+        }
+
+        // Calls function with each memory type in memoryTypeBits which has all of properties, until it succeeds.
+        template<typename Function>
+        VkResult forEachMemoryType(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties, Function&& function) {
+            VkResult result = VK_RESULT_MAX_ENUM;
+            for (uint32_t mask = memoryTypeMask(memoryTypeBits, properties); mask; mask &= mask - 1)
+                if (!(result = function(uint32_t(std::countr_zero(mask)))))
+                    return VK_SUCCESS;
+            if (result == VK_RESULT_MAX_ENUM)
+                outStream << std::format("Failed to find a memory type with properties {:#x} among {:#b}!", properties, memoryTypeBits) << std::endl;
+            return result;
+        }
+
+    public:
+        const VkPhysicalDeviceMemoryProperties& getMemoryProperties() const { return memoryProperties; }
+        HeapStatistics getHeapStatistics(uint32_t heapIndex) const {
+            std::lock_guard lock(mutex);
+            return heapStatistics[heapIndex];
+        }
+        uint32_t getDeviceAllocationCount() const {
+            std::lock_guard lock(mutex);
+            return deviceAllocationCount;
+        }
+        HeapBudget getHeapBudget(uint32_t heapIndex) const {
+            std::lock_guard lock(mutex);
+            return heapBudgets[heapIndex];
+        }
+        bool isMemoryBudgetEnabled() const { return memoryBudgetEnabled; }
+        // Same as GraphicsBase::findMemoryTypeIndex(), but cached.
+        uint32_t findMemoryTypeIndex(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties) {
+            std::lock_guard lock(mutex);
+            uint32_t mask = memoryTypeMask(memoryTypeBits, properties);
+            return mask ? uint32_t(std::countr_zero(mask)) : UINT32_MAX;
+        }
+
+        // memoryBudget tells whether VK_EXT_memory_budget is enabled on the device.
+        void setDevice(VkDevice device, VkPhysicalDevice physicalDevice, bool memoryBudget) {
+            this->device = device;
+            this->physicalDevice = physicalDevice;
+            memoryBudgetEnabled = memoryBudget;
+            vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+            bufferImageGranularity = properties.limits.bufferImageGranularity;
+            maxAllocationCount = properties.limits.maxMemoryAllocationCount;
+            memoryTypeMasks.clear();
+            updateBudget();
+        }
+
+        // Samples the budget and the usage of every heap, GraphicsBase::advanceFrame() calls it once a frame.
+        // Without VK_EXT_memory_budget, the budget is 80% of the heap and only this allocator's usage is known.
+        void updateBudget() {
+            std::lock_guard lock(mutex);
+            if (!memoryBudgetEnabled) {
+                for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+                    heapBudgets[i].budget = memoryProperties.memoryHeaps[i].size / 5 * 4;
+                return;
+            }
+            VkPhysicalDeviceMemoryBudgetPropertiesEXT memoryBudgetProperties = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT
+            };
+            VkPhysicalDeviceMemoryProperties2 memoryProperties2 = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+                .pNext = &memoryBudgetProperties
+            };
+            vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &memoryProperties2);
+            for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+                heapBudgets[i] = { memoryBudgetProperties.heapBudget[i], memoryBudgetProperties.heapUsage[i] };
+        }
+
+        // linear is true for buffers and VK_IMAGE_TILING_LINEAR images, false for optimal images.
+        result_t allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear, Allocation& allocation) {
+            std::lock_guard lock(mutex);
+            VkDeviceSize nodeSize = std::bit_ceil(std::max({ requirements.size, requirements.alignment, minNodeSize }));
+            linear = linear || bufferImageGranularity <= minNodeSize;
+            return forEachMemoryType(requirements.memoryTypeBits, properties, [&](uint32_t memoryTypeIndex) {
+                if (nodeSize > blockSizeOf(memoryTypeIndex) / 2)
+                    return allocateDedicatedInternal(requirements, memoryTypeIndex, allocation, VK_NULL_HANDLE, VK_NULL_HANDLE);
+                allocation = { .size = nodeSize, .memoryTypeIndex = memoryTypeIndex };
+                Block* pBlock = nullptr;
+                for (auto& i : blocks[memoryTypeIndex])
+                    if (i->linear == linear &&
+                        allocateNode(*i, nodeSize, allocation.offset)) {
+                        pBlock = i.get();
+                        break;
+                    }
+                if (!pBlock) {
+                    if (VkResult result = createBlock(memoryTypeIndex, linear, pBlock))
+                        return result;
+                    allocateNode(*pBlock, nodeSize, allocation.offset);
+                }
+                allocation.memory = pBlock->memory;
+                allocation.pBlock = pBlock;
+                if (pBlock->pMappedData)
+                    allocation.pMappedData = static_cast<uint8_t*>(pBlock->pMappedData) + allocation.offset;
+                HeapStatistics& statistics = heapStatisticsOf(memoryTypeIndex);
+                statistics.allocationCount++;
+                statistics.allocatedBytes += nodeSize;
+                return VK_SUCCESS;
+            });
+        }
+        // For large resources, or ones whose VkMemoryDedicatedRequirements prefer it. Passing the buffer or the image
+        // chains VkMemoryDedicatedAllocateInfo.
+        result_t allocateDedicated(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, Allocation& allocation,
+            VkBuffer buffer = VK_NULL_HANDLE, VkImage image = VK_NULL_HANDLE) {
+            std::lock_guard lock(mutex);
+            return forEachMemoryType(requirements.memoryTypeBits, properties, [&](uint32_t memoryTypeIndex) {
+                return allocateDedicatedInternal(requirements, memoryTypeIndex, allocation, buffer, image);
+            });
+        }
+
+        // An emptied block is freed unless it's the last one of its memory type, which is kept to avoid churn.
+        void free(Allocation& allocation) {
+            if (!allocation)
+                return;
+            std::lock_guard lock(mutex);
+            HeapStatistics& statistics = heapStatisticsOf(allocation.memoryTypeIndex);
+            if (allocation.isDedicated()) {
+                freeMemory(allocation.memory, allocation.memoryTypeIndex, allocation.size);
+                statistics.dedicatedAllocationCount--;
+                statistics.dedicatedBytes -= allocation.size;
+            }
+            else {
+                Block& block = *static_cast<Block*>(allocation.pBlock);
+                freeNode(block, allocation.size, allocation.offset);
+                statistics.allocationCount--;
+                statistics.allocatedBytes -= allocation.size;
+                if (!block.allocationCount &&
+                    blocks[allocation.memoryTypeIndex].size() > 1)
+                    destroyBlock(allocation.memoryTypeIndex, &block);
+            }
+            allocation = {};
+        }
+
+        // Allocations still held by users are not tracked and must be freed before this is called.
+        void destroy() {
+            std::lock_guard lock(mutex);
+            for (auto& i : blocks)
+                for (auto& j : i)
+                    vkFreeMemory(device, j->memory, HostAllocator::pCallbacks);
+            for (auto& i : blocks)
+                i.clear();
+            for (auto& i : heapStatistics)
+                i = {};
+            for (auto& i : heapBudgets)
+                i = {};
+            deviceAllocationCount = 0;
+        }
+    };
+
+    // The pipeline cache, persisted across runs so that pipelines compiled before are only looked up.
+    // load() reads the file on another thread, so call it early, e.g. before the instance is created; createDevice()
+    // then creates the cache from the data if its header matches the physical device, otherwise empty.
+    // The data is written back every saveInterval on another thread, if it changed, and when the device is destroyed,
+    // each time to a temporary file which then replaces the old one, so that a crash never leaves a truncated cache.
+    class PipelineCache {
+        VkDevice device = VK_NULL_HANDLE;
+        VkPipelineCache handle = VK_NULL_HANDLE;
+        std::string filepath;
+        std::future<std::vector<uint8_t>> fileData;
+        std::future<void> saving;
+        // Hash of the bytes last written to or read from the file.
+        size_t savedHash = 0;
+        std::chrono::steady_clock::time_point timeSaved;
+
+        static std::vector<uint8_t> readFile(const std::string& filepath) {
+            std::ifstream file(filepath, std::ios::ate | std::ios::binary);
+            if (!file)
+                return {};
+            std::vector<uint8_t> data(size_t(file.tellg()));
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(data.data()), data.size());
+            return data;
+        }
+        static size_t hashOf(const std::vector<uint8_t>& data) {
+            return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(data.data()), data.size()));
+        }
+        static bool isCompatible(const std::vector<uint8_t>& data, const VkPhysicalDeviceProperties& properties) {
+            VkPipelineCacheHeaderVersionOne header;
+            if (data.size() < sizeof header)
+                return false;
+            memcpy(&header, data.data(), sizeof header);
+            return header.headerSize >= sizeof header &&
+                header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                header.vendorID == properties.vendorID &&
+                header.deviceID == properties.deviceID &&
+                !memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+        }
+        // Does nothing if the data didn't change since it was last saved.
+        void write() {
+            size_t dataSize = 0;
+            if (VkResult result = vkGetPipelineCacheData(device, handle, &dataSize, nullptr)) {
+                outStream << std::format("Failed to get the size of the pipeline cache data!\nError code: {}", int32_t(result)) << std::endl;
+                return;
+            }
+            std::vector<uint8_t> data(dataSize);
+            if (VkResult result = vkGetPipelineCacheData(device, handle, &dataSize, data.data())) {
+                outStream << std::format("Failed to get the pipeline cache data!\nError code: {}", int32_t(result)) << std::endl;
+                return;
+            }
+            data.resize(dataSize);
+            size_t dataHash = hashOf(data);
+            if (dataHash == savedHash)
+                return;
+            std::string filepathTemporary = filepath + ".tmp";
+            {
+                std::ofstream file(filepathTemporary, std::ios::binary | std::ios::trunc);
+                if (!file.write(reinterpret_cast<const char*>(data.data()), dataSize)) {
+                    outStream << std::format("Failed to write the file: {}", filepathTemporary) << std::endl;
+                    return;
+                }
+            }
+            std::error_code errorCode;
+            std::filesystem::rename(filepathTemporary, filepath, errorCode);
+            if (errorCode) {
+                outStream << std::format("Failed to replace the file: {}\n{}", filepath, errorCode.message()) << std::endl;
+                return;
+            }
+            savedHash = dataHash;
+        }
+
+    public:
+        inline static std::chrono::seconds saveInterval{ 30 };
+
+        operator VkPipelineCache() const { return handle; }
+
+        // An empty filepath keeps the cache in memory only.
+        void load(std::string filepath) {
+            this->filepath = std::move(filepath);
+            if (this->filepath.size())
+                fileData = std::async(std::launch::async, readFile, this->filepath);
+        }
+
+        result_t setDevice(VkDevice device, const VkPhysicalDeviceProperties& properties) {
+            this->device = device;
+            std::vector<uint8_t> data =
+                fileData.valid() ? fileData.get() :
+                filepath.size() ? readFile(filepath) : std::vector<uint8_t>{};
+            if (data.size() &&
+                !isCompatible(data, properties))
+                outStream << std::format("The pipeline cache in {} was made by another device or driver and is discarded.", filepath) << std::endl,
+                data.clear();
+            VkPipelineCacheCreateInfo createInfo = {
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+                .initialDataSize = data.size(),
+                .pInitialData = data.data()
+            };
+            if (VkResult result = vkCreatePipelineCache(device, &createInfo, HostAllocator::pCallbacks, &handle)) {
+                outStream << std::format("Failed to create a pipeline cache!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            savedHash = hashOf(data);
+            timeSaved = std::chrono::steady_clock::now();
+            return VK_SUCCESS;
+        }
+
+        // Starts a save once saveInterval passed since the last one, unless one is still running.
+        void newFrame() {
+            if (!handle || filepath.empty() ||
+                std::chrono::steady_clock::now() - timeSaved < saveInterval ||
+                (saving.valid() && saving.wait_for(std::chrono::seconds(0)) != std::future_status::ready))
+                return;
+            timeSaved = std::chrono::steady_clock::now();
+            saving = std::async(std::launch::async, [this] { write(); });
+        }
+
+        // Waits for a running save, then saves and destroys the cache.
+        void destroy() {
+            if (saving.valid())
+                saving.get();
+            if (!handle)
+                return;
+            if (filepath.size())
+                write();
+            vkDestroyPipelineCache(device, handle, HostAllocator::pCallbacks);
+            handle = VK_NULL_HANDLE;
+            savedHash = 0;
+        }
+    };
+
+    // Threads for work handed off again and again, e.g. by Pipeline::createAsync(), started on first use, one per core,
+    // and kept until the pool is destroyed. Jobs must not wait on other jobs, which may be queued behind them.
+    class WorkerPool {
+        std::vector<std::thread> threads;
+        std::deque<std::function<void()>> jobs;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping = false;
+
+        // Jobs already pushed are still run when the pool is being destroyed.
+        void work() {
+            while (true) {
+                std::unique_lock lock(mutex);
+                condition.wait(lock, [this] { return stopping || jobs.size(); });
+                if (jobs.empty())
+                    return;
+                std::function<void()> job = std::move(jobs.front());
+                jobs.pop_front();
+                lock.unlock();
+                job();
+            }
+        }
+
+    public:
+        WorkerPool() = default;
+        WorkerPool(WorkerPool&&) = delete;
+        ~WorkerPool() {
+            {
+                std::lock_guard lock(mutex);
+                stopping = true;
+            }
+            condition.notify_all();
+            for (auto& i : threads)
+                i.join();
+        }
+
+        static uint32_t getThreadCount() {
+            return std::max(std::thread::hardware_concurrency(), 1u);
+        }
+
+        void push(std::function<void()> job) {
+            {
+                std::lock_guard lock(mutex);
+                if (threads.empty())
+                    for (uint32_t i = getThreadCount(); i--;)
+                        threads.emplace_back([this] { work(); });
+                jobs.push_back(std::move(job));
+            }
+            condition.notify_one();
+        }
+    };
+
     class GraphicsBase {
 
         static GraphicsBase singleton;
         GraphicsBase() = default;
         GraphicsBase(GraphicsBase&&) = delete;
         ~GraphicsBase() {
+            destroyObjects();
+        }
+        // Destroys the Vulkan objects but leaves the members alive, so that terminate() can reuse them.
+        void destroyObjects() {
             if (!instance)
                 return;
             if (device) {
@@ -21,21 +846,38 @@ namespace Vulkan {
                     for (auto& i : callbacksDestroySwapchain) i();
                     for (auto& i : swapchainImageViews)
                         if (i)
-                            vkDestroyImageView(device, i, nullptr);
-                    vkDestroySwapchainKHR(device, swapchain, nullptr);
+                            vkDestroyImageView(device, i, HostAllocator::pCallbacks);
+                    vkDestroySwapchainKHR(device, swapchain, HostAllocator::pCallbacks);
+                }
+                for (auto& i : presentFences)
+                    syncObjectPool.recycleFence(i.fence);
+                for (auto& i : retiredSwapchains)
+                    destroyRetiredSwapchain(i);
+                if (headless) {
+                    for (auto& i : callbacksDestroySwapchain) i();
+                    destroyHeadlessImages();
                 }
+                for (auto& i : timelines) {
+                    if (i.semaphore)
+                        vkDestroySemaphore(device, i.semaphore, HostAllocator::pCallbacks);
+                    for (auto& [value, fence] : i.pendingFences)
+                        syncObjectPool.recycleFence(fence);
+                }
+                syncObjectPool.destroy();
+                memoryAllocator.destroy();
+                pipelineCache.destroy();
                 // for (auto& i : callbacksDestroyDevice) i();
-                vkDestroyDevice(device, nullptr);
+                vkDestroyDevice(device, HostAllocator::pCallbacks);
             }
             if (surface)
-                vkDestroySurfaceKHR(instance, surface, nullptr);
+                vkDestroySurfaceKHR(instance, surface, HostAllocator::pCallbacks);
             if (debugUtilsMessenger) {
                 PFN_vkDestroyDebugUtilsMessengerEXT DestroyDebugUtilsMessenger =
                     reinterpret_cast<PFN_vkDestroyDebugUtilsMessengerEXT>(vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT"));
                 if (DestroyDebugUtilsMessenger)
-                    DestroyDebugUtilsMessenger(instance, debugUtilsMessenger, nullptr);
+                    DestroyDebugUtilsMessenger(instance, debugUtilsMessenger, HostAllocator::pCallbacks);
             }
-            vkDestroyInstance(instance, nullptr);
+            vkDestroyInstance(instance, HostAllocator::pCallbacks);
         }
     
     public:
@@ -87,7 +929,7 @@ namespace Vulkan {
                 .ppEnabledExtensionNames = instanceExtensions.data()
             };
 
-            if (result_t result = vkCreateInstance(&instanceCreateInfo, nullptr, &instance)) {
+            if (result_t result = vkCreateInstance(&instanceCreateInfo, HostAllocator::pCallbacks, &instance)) {
                 outStream << Message::ERROR_CREATING_INSTANCE << std::endl;
                 return result;
             }
@@ -201,7 +1043,7 @@ namespace Vulkan {
                 );
                 
             if (createDebugUtilsMessenger) {
-                result_t result = createDebugUtilsMessenger(instance, &debugUtilsMessengerCreateInfo, nullptr, &debugUtilsMessenger);
+                result_t result = createDebugUtilsMessenger(instance, &debugUtilsMessengerCreateInfo, HostAllocator::pCallbacks, &debugUtilsMessenger);
                 if (result) outStream << Message::ERROR_CREATING_DEBUG_MESSENGER << std::endl;
                 return result;
             }
@@ -228,6 +1070,7 @@ namespace Vulkan {
     private:
         VkPhysicalDevice physicalDevice;
         VkPhysicalDeviceProperties physicalDeviceProperties;
+        VkPhysicalDeviceFeatures physicalDeviceFeatures;
         VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties;
         std::vector<VkPhysicalDevice> availablePhysicalDevices;
 
@@ -235,21 +1078,34 @@ namespace Vulkan {
         uint32_t queueFamilyIndexGraphics = VK_QUEUE_FAMILY_IGNORED;
         uint32_t queueFamilyIndexPresentation = VK_QUEUE_FAMILY_IGNORED;
         uint32_t queueFamilyIndexCompute = VK_QUEUE_FAMILY_IGNORED;
-        VkQueue queueGraphics;
-        VkQueue queuePresentation;
-        VkQueue queueCompute;
+        uint32_t queueFamilyIndexTransfer = VK_QUEUE_FAMILY_IGNORED;
+        VkQueue queueGraphics = VK_NULL_HANDLE;
+        VkQueue queuePresentation = VK_NULL_HANDLE;
+        VkQueue queueCompute = VK_NULL_HANDLE;
+        VkQueue queueTransfer = VK_NULL_HANDLE;
 
         std::vector<const char*> deviceExtensions;
-
-        result_t getQueueFamilyIndices(VkPhysicalDevice physicalDevice, bool enableGraphicsQueue, bool enableComputeQueue, uint32_t (&queueFamilyIndices)[3]) {
+        bool memoryBudgetEnabled = false;
+        SyncObjectPool syncObjectPool;
+        MemoryAllocator memoryAllocator;
+        PipelineCache pipelineCache;
+        WorkerPool workerPool;
+
+        // The transfer family is optional: a family with transfer but neither graphics nor compute, which is usually
+        // backed by DMA engines that run alongside rendering. Without one, transfers go to the graphics queue.
+        result_t getQueueFamilyIndices(VkPhysicalDevice physicalDevice, bool enableGraphicsQueue, bool enableComputeQueue, uint32_t (&queueFamilyIndices)[4]) {
             uint32_t queueFamilyCount = 0;
             vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
             if (!queueFamilyCount)
                 return VK_RESULT_MAX_ENUM;
             std::vector<VkQueueFamilyProperties> queueFamilyPropertieses(queueFamilyCount);
             vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyPropertieses.data());
-            auto& [ig, ip, ic] = queueFamilyIndices;
-            ig = ip = ic = VK_QUEUE_FAMILY_IGNORED;
+            auto& [ig, ip, ic, it] = queueFamilyIndices;
+            ig = ip = ic = it = VK_QUEUE_FAMILY_IGNORED;
+            for (uint32_t i = 0; i < queueFamilyCount; i++)
+                if (enableGraphicsQueue && it == VK_QUEUE_FAMILY_IGNORED &&
+                    (queueFamilyPropertieses[i].queueFlags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) == VK_QUEUE_TRANSFER_BIT)
+                    it = i;
             for (uint32_t i = 0; i < queueFamilyCount; i++) {
                 VkBool32
                     supportGraphics = enableGraphicsQueue && queueFamilyPropertieses[i].queueFlags & VK_QUEUE_GRAPHICS_BIT,
@@ -284,6 +1140,7 @@ namespace Vulkan {
             queueFamilyIndexGraphics = ig;
             queueFamilyIndexPresentation = ip;
             queueFamilyIndexCompute = ic;
+            queueFamilyIndexTransfer = it;
             return VK_SUCCESS;
         }
 
@@ -294,9 +1151,21 @@ namespace Vulkan {
         const VkPhysicalDeviceProperties& getPhysicalDeviceProperties() const {
             return physicalDeviceProperties;
         }
+        // Core features supported by the physical device, createDevice() enables all of them.
+        const VkPhysicalDeviceFeatures& getPhysicalDeviceFeatures() const {
+            return physicalDeviceFeatures;
+        }
         const VkPhysicalDeviceMemoryProperties& getPhysicalDeviceMemoryProperties() const {
             return physicalDeviceMemoryProperties;
         }
+        // Returns the first memory type in memoryTypeBits with all of properties, UINT32_MAX if there is none.
+        uint32_t findMemoryTypeIndex(uint32_t memoryTypeBits, VkMemoryPropertyFlags properties) const {
+            for (uint32_t i = 0; i < physicalDeviceMemoryProperties.memoryTypeCount; i++)
+                if (memoryTypeBits & 1 << i &&
+                    (physicalDeviceMemoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+                    return i;
+            return UINT32_MAX;
+        }
         VkPhysicalDevice getAvailablePhysicalDevice(uint32_t index) const {
             return availablePhysicalDevices[index];
         }
@@ -316,6 +1185,10 @@ namespace Vulkan {
         uint32_t getQueueFamilyIndexCompute() const {
             return queueFamilyIndexCompute;
         }
+        // The graphics queue family if the device has no dedicated transfer family.
+        uint32_t getQueueFamilyIndexTransfer() const {
+            return queueFamilyIndexTransfer;
+        }
         VkQueue getQueueGraphics() const {
             return queueGraphics;
         }
@@ -325,10 +1198,25 @@ namespace Vulkan {
         VkQueue getQueueCompute() const {
             return queueCompute;
         }
+        VkQueue getQueueTransfer() const {
+            return queueTransfer;
+        }
 
         const std::vector<const char*>& getDeviceExtensions() const {
             return deviceExtensions;
         }
+        SyncObjectPool& getSyncObjectPool() {
+            return syncObjectPool;
+        }
+        MemoryAllocator& getMemoryAllocator() {
+            return memoryAllocator;
+        }
+        PipelineCache& getPipelineCache() {
+            return pipelineCache;
+        }
+        WorkerPool& getWorkerPool() {
+            return workerPool;
+        }
 
         void pushDeviceExtension(const char* extensionName) {
             addLayerOrExtension(deviceExtensions, extensionName);
@@ -355,9 +1243,10 @@ namespace Vulkan {
                 uint32_t graphics = VK_QUEUE_FAMILY_IGNORED;
                 uint32_t presentation = VK_QUEUE_FAMILY_IGNORED;
                 uint32_t compute = VK_QUEUE_FAMILY_IGNORED;
+                uint32_t transfer = VK_QUEUE_FAMILY_IGNORED;
             };
             static std::vector<queueFamilyIndexCombination> queueFamilyIndexCombinations(availablePhysicalDevices.size());
-            auto& [ig, ip, ic] = queueFamilyIndexCombinations[deviceIndex];
+            auto& [ig, ip, ic, it] = queueFamilyIndexCombinations[deviceIndex];
 
             if (ig == notFound && enableGraphicsQueue ||
                 ip == notFound && surface ||
@@ -367,7 +1256,7 @@ namespace Vulkan {
             if (ig == VK_QUEUE_FAMILY_IGNORED && enableGraphicsQueue ||
                 ip == VK_QUEUE_FAMILY_IGNORED && surface ||
                 ic == VK_QUEUE_FAMILY_IGNORED && enableComputeQueue) {
-                uint32_t indices[3];
+                uint32_t indices[4];
                 result_t result = getQueueFamilyIndices(availablePhysicalDevices[deviceIndex], enableGraphicsQueue, enableComputeQueue, indices);
                 if (result == VK_SUCCESS ||
                     result == VK_RESULT_MAX_ENUM) {
@@ -377,6 +1266,7 @@ namespace Vulkan {
                         ip = indices[1] & INT32_MAX;
                     if (enableComputeQueue)
                         ic = indices[2] & INT32_MAX;
+                    it = indices[3];
                 }
                 if (result)
                     return result;
@@ -384,6 +1274,7 @@ namespace Vulkan {
                 queueFamilyIndexGraphics = enableGraphicsQueue ? ig : VK_QUEUE_FAMILY_IGNORED;
                 queueFamilyIndexPresentation = surface ? ip : VK_QUEUE_FAMILY_IGNORED;
                 queueFamilyIndexCompute = enableComputeQueue ? ic : VK_QUEUE_FAMILY_IGNORED;
+                queueFamilyIndexTransfer = enableGraphicsQueue ? it : VK_QUEUE_FAMILY_IGNORED;
             }
             physicalDevice = availablePhysicalDevices[deviceIndex];
             return VK_SUCCESS;
@@ -391,7 +1282,11 @@ namespace Vulkan {
 
         result_t createDevice(const void* pNext = nullptr, VkDeviceCreateFlags flags = 0) {
             float queuePriority = 1.f;
-            VkDeviceQueueCreateInfo queueCreateInfos[3] = {
+            VkDeviceQueueCreateInfo queueCreateInfos[4] = {
+                {
+                    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+                    .queueCount = 1,
+                    .pQueuePriorities = &queuePriority },
                 {
                     .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
                     .queueCount = 1,
@@ -414,13 +1309,87 @@ namespace Vulkan {
                 queueFamilyIndexCompute != queueFamilyIndexGraphics &&
                 queueFamilyIndexCompute != queueFamilyIndexPresentation)
                 queueCreateInfos[queueCreateInfoCount++].queueFamilyIndex = queueFamilyIndexCompute;
+            // Never equal to the others, it has neither graphics nor compute.
+            if (queueFamilyIndexTransfer != VK_QUEUE_FAMILY_IGNORED &&
+                queueFamilyIndexTransfer != queueFamilyIndexPresentation)
+                queueCreateInfos[queueCreateInfoCount++].queueFamilyIndex = queueFamilyIndexTransfer;
 
-            VkPhysicalDeviceFeatures physicalDeviceFeatures;
             vkGetPhysicalDeviceFeatures(physicalDevice, &physicalDeviceFeatures);
 
+            vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+            // Optional features are queried with one VkPhysicalDeviceFeatures2 chain, the supported ones are prepended to pNext.
+            VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES
+            };
+            VkPhysicalDeviceSwapchainMaintenance1FeaturesEXT swapchainMaintenance1Features = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SWAPCHAIN_MAINTENANCE_1_FEATURES_EXT
+            };
+            VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR
+            };
+            VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures = {
+                .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR
+            };
+            const char* presentWaitExtensions[] = { VK_KHR_PRESENT_ID_EXTENSION_NAME, VK_KHR_PRESENT_WAIT_EXTENSION_NAME };
+            bool presentWaitAvailable =
+                surface &&
+                !checkDeviceExtensions(presentWaitExtensions) && presentWaitExtensions[0] && presentWaitExtensions[1];
+            const char* swapchainMaintenance1Extension[] = { VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME };
+            bool surfaceMaintenance1Enabled = false;
+            for (auto& i : instanceExtensions)
+                if (!strcmp(i, VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME))
+                    surfaceMaintenance1Enabled = true;
+            bool swapchainMaintenance1Available =
+                surface && surfaceMaintenance1Enabled &&
+                !checkDeviceExtensions(swapchainMaintenance1Extension) && swapchainMaintenance1Extension[0];
+
+            void* pNextQuery = nullptr;
+            if (presentWaitAvailable)
+                presentWaitFeatures.pNext = pNextQuery,
+                presentIdFeatures.pNext = &presentWaitFeatures,
+                pNextQuery = &presentIdFeatures;
+            if (swapchainMaintenance1Available)
+                swapchainMaintenance1Features.pNext = pNextQuery,
+                pNextQuery = &swapchainMaintenance1Features;
+            if (physicalDeviceProperties.apiVersion >= VK_API_VERSION_1_2)
+                timelineSemaphoreFeatures.pNext = pNextQuery,
+                pNextQuery = &timelineSemaphoreFeatures;
+            if (pNextQuery) {
+                VkPhysicalDeviceFeatures2 physicalDeviceFeatures2 = {
+                    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+                    .pNext = pNextQuery
+                };
+                vkGetPhysicalDeviceFeatures2(physicalDevice, &physicalDeviceFeatures2);
+            }
+
+            void* pNextEnabled = const_cast<void*>(pNext);
+            timelineSemaphoreEnabled = timelineSemaphoreFeatures.timelineSemaphore;
+            if (timelineSemaphoreEnabled)
+                timelineSemaphoreFeatures.pNext = pNextEnabled,
+                pNextEnabled = &timelineSemaphoreFeatures;
+            swapchainMaintenance1Enabled = swapchainMaintenance1Features.swapchainMaintenance1;
+            if (swapchainMaintenance1Enabled) {
+                swapchainMaintenance1Features.pNext = pNextEnabled;
+                pNextEnabled = &swapchainMaintenance1Features;
+                pushDeviceExtension(VK_EXT_SWAPCHAIN_MAINTENANCE_1_EXTENSION_NAME);
+            }
+            presentWaitEnabled = presentIdFeatures.presentId && presentWaitFeatures.presentWait;
+            if (presentWaitEnabled) {
+                presentWaitFeatures.pNext = pNextEnabled;
+                presentIdFeatures.pNext = &presentWaitFeatures;
+                pNextEnabled = &presentIdFeatures;
+                pushDeviceExtension(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+                pushDeviceExtension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+            }
+            const char* memoryBudgetExtension[] = { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME };
+            memoryBudgetEnabled = !checkDeviceExtensions(memoryBudgetExtension) && memoryBudgetExtension[0];
+            if (memoryBudgetEnabled)
+                pushDeviceExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
             VkDeviceCreateInfo deviceCreateInfo = {
                 .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-                .pNext = pNext,
+                .pNext = pNextEnabled,
                 .flags = flags,
                 .queueCreateInfoCount = queueCreateInfoCount,
                 .pQueueCreateInfos = queueCreateInfos,
@@ -429,7 +1398,7 @@ namespace Vulkan {
                 .pEnabledFeatures = &physicalDeviceFeatures
             };
 
-            if (result_t result = vkCreateDevice(physicalDevice, &deviceCreateInfo, nullptr, &device)) {
+            if (result_t result = vkCreateDevice(physicalDevice, &deviceCreateInfo, HostAllocator::pCallbacks, &device)) {
                 outStream << std::format("Failed to create a vulkan logical device!\nError code: {}", int32_t(result)) << std::endl;
                 return result;
             }
@@ -440,15 +1409,51 @@ namespace Vulkan {
                 vkGetDeviceQueue(device, queueFamilyIndexPresentation, 0, &queuePresentation);
             if (queueFamilyIndexCompute != VK_QUEUE_FAMILY_IGNORED)
                 vkGetDeviceQueue(device, queueFamilyIndexCompute, 0, &queueCompute);
+            if (queueFamilyIndexTransfer != VK_QUEUE_FAMILY_IGNORED)
+                vkGetDeviceQueue(device, queueFamilyIndexTransfer, 0, &queueTransfer);
+            else
+                queueFamilyIndexTransfer = queueFamilyIndexGraphics,
+                queueTransfer = queueGraphics;
         
-            vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
             vkGetPhysicalDeviceMemoryProperties(physicalDevice, &physicalDeviceMemoryProperties);
             std::cout << std::format("Renderer: {}", physicalDeviceProperties.deviceName) << std::endl;
-            
-            return VK_SUCCESS;
+
+            syncObjectPool.setDevice(device);
+            memoryAllocator.setDevice(device, physicalDevice, memoryBudgetEnabled);
+            pipelineCache.setDevice(device, physicalDeviceProperties);
+            if (presentWaitEnabled)
+                vkWaitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(vkGetDeviceProcAddr(device, "vkWaitForPresentKHR"));
+
+            return createTimelines();
         }
 
         result_t checkDeviceExtensions(std::span<const char*> extensionsToCheck, const char* layerName = nullptr) const {
+            uint32_t extensionCount;
+            std::vector<VkExtensionProperties> availableExtensions;
+            if (result_t result = vkEnumerateDeviceExtensionProperties(physicalDevice, layerName, &extensionCount, nullptr)) {
+                outStream << std::format("Failed to get the count of device extensions!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            if (extensionCount) {
+                availableExtensions.resize(extensionCount);
+                if (result_t result = vkEnumerateDeviceExtensionProperties(physicalDevice, layerName, &extensionCount, availableExtensions.data())) {
+                    outStream << std::format("Failed to enumerate device extensions!\nError code: {}", int32_t(result)) << std::endl;
+                    return result;
+                }
+                for (auto& i : extensionsToCheck) {
+                    bool found = false;
+                    for (auto& j : availableExtensions)
+                        if (!strcmp(i, j.extensionName)) {
+                            found = true;
+                            break;
+                        }
+                    if (!found)
+                        i = nullptr;
+                }
+            }
+            else
+                for (auto& i : extensionsToCheck)
+                    i = nullptr;
             return VK_SUCCESS;
         }
 
@@ -459,6 +1464,7 @@ namespace Vulkan {
     // Image View
     private:
         std::vector <VkSurfaceFormatKHR> availableSurfaceFormats;
+        std::vector <VkPresentModeKHR> availableSurfacePresentModes;
 
         VkSwapchainKHR swapchain;
         std::vector <VkImage> swapchainImages;
@@ -467,7 +1473,7 @@ namespace Vulkan {
 
         result_t createSwapchainInternal() {
 
-            if (result_t result = vkCreateSwapchainKHR(device, &swapchainCreateInfo, nullptr, &swapchain)) {
+            if (result_t result = vkCreateSwapchainKHR(device, &swapchainCreateInfo, HostAllocator::pCallbacks, &swapchain)) {
                 outStream << std::format("Failed to create a swapchain.\nError code: {}", int32_t(result)) << std::endl;
                 return result;
             }
@@ -483,6 +1489,8 @@ namespace Vulkan {
                 return result;
             }
 
+            swapchainImageTimelineValues.assign(swapchainImageCount, 0);
+
             swapchainImageViews.resize(swapchainImageCount);
             VkImageViewCreateInfo imageViewCreateInfo = {
                 .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -492,7 +1500,7 @@ namespace Vulkan {
             };
             for (size_t i = 0; i < swapchainImageCount; i++) {
                 imageViewCreateInfo.image = swapchainImages[i];
-                if (result_t result = vkCreateImageView(device, &imageViewCreateInfo, nullptr, &swapchainImageViews[i])) {
+                if (result_t result = vkCreateImageView(device, &imageViewCreateInfo, HostAllocator::pCallbacks, &swapchainImageViews[i])) {
                     outStream << std::format("Failed to create a swapchain image view.\nError code: {}\n", int32_t(result)) << std::endl;
                     return result;
                 }
@@ -551,6 +1559,42 @@ namespace Vulkan {
             return result;
         }
 
+        const std::vector<VkPresentModeKHR>& getAvailableSurfacePresentModes() const {
+            return availableSurfacePresentModes;
+        }
+
+        result_t getSurfacePresentModes() {
+            uint32_t surfacePresentModeCount;
+            if (result_t result = vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &surfacePresentModeCount, nullptr)) {
+                outStream << std::format("Failed to get the count of surface present modes.\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            if (!surfacePresentModeCount)
+                throw std::runtime_error("Failed to find any surface present mode.");
+            availableSurfacePresentModes.resize(surfacePresentModeCount);
+            result_t result = vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &surfacePresentModeCount, availableSurfacePresentModes.data());
+            if (result)
+                outStream << std::format("Failed to get surface present modes.\nError code: {}", int32_t(result)) << std::endl;
+            return result;
+        }
+
+        // Uses the first of preferences the surface supports, FIFO being the fallback every surface supports.
+        // A live swapchain is recreated in place, the device is left untouched.
+        result_t setPresentMode(ArrayRef<const VkPresentModeKHR> preferences) {
+            VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            for (auto& i : preferences)
+                if (std::find(availableSurfacePresentModes.begin(), availableSurfacePresentModes.end(), i) != availableSurfacePresentModes.end()) {
+                    presentMode = i;
+                    break;
+                }
+            if (swapchain &&
+                presentMode == swapchainCreateInfo.presentMode)
+                return VK_SUCCESS;
+            swapchainCreateInfo.presentMode = presentMode;
+            if (swapchain) return recreateSwapchain();
+            return VK_SUCCESS;
+        }
+
         result_t setSurfaceFormat(VkSurfaceFormatKHR surfaceFormat) {
             bool formatIsAvailable = false;
             if (!surfaceFormat.format) {
@@ -625,24 +1669,13 @@ namespace Vulkan {
                 }
             }
 
-            uint32_t surfacePresentModeCount;
-            if (result_t result = vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &surfacePresentModeCount, nullptr)) {
-                outStream << std::format("Failed to get the count of surface present modes.\nError code: {}", int32_t(result)) << std::endl;
-                return result;
-            }
-            if (!surfacePresentModeCount)
-                throw std::runtime_error("Failed to find any surface present mode.");
-
-            std::vector<VkPresentModeKHR> surfacePresentModes(surfacePresentModeCount);
-            if (result_t result = vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &surfacePresentModeCount, surfacePresentModes.data())) {
-                outStream << std::format("Failed to get surface present modes.\nError code: {}", int32_t(result)) << std::endl;
-                return result;
-            }
+            if (availableSurfacePresentModes.empty())
+                if (result_t result = getSurfacePresentModes()) return result;
 
             swapchainCreateInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
             if (!limitFrameRate)
-                for (size_t i = 0; i < surfacePresentModeCount; i++)
-                    if (surfacePresentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
+                for (auto& i : availableSurfacePresentModes)
+                    if (i == VK_PRESENT_MODE_MAILBOX_KHR) {
                         swapchainCreateInfo.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
                         break;
                     }
@@ -655,7 +1688,7 @@ namespace Vulkan {
             swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
             swapchainCreateInfo.clipped = VK_TRUE;
 
-            if (result_t result = vkCreateSwapchainKHR(device, &swapchainCreateInfo, nullptr, &swapchain)) {
+            if (result_t result = vkCreateSwapchainKHR(device, &swapchainCreateInfo, HostAllocator::pCallbacks, &swapchain)) {
                 outStream << std::format("Failed to create a swapchain.\nError code: {}", int32_t(result)) << std::endl;
                 return result;
             }
@@ -667,6 +1700,9 @@ namespace Vulkan {
         }
         
         result_t recreateSwapchain() {
+            cpuZone("GraphicsBase::recreateSwapchain");
+            if (headless)
+                return recreateHeadlessSwapchain();
             VkSurfaceCapabilitiesKHR surfaceCapabilities = {};
             if (result_t result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities)) {
                 outStream << std::format("Failed to get physical device surface capabilities.\nError code: {}", int32_t(result)) << std::endl;
@@ -678,23 +1714,21 @@ namespace Vulkan {
             swapchainCreateInfo.imageExtent = surfaceCapabilities.currentExtent;
             swapchainCreateInfo.oldSwapchain = swapchain;
 
-            result_t result = vkQueueWaitIdle(queueGraphics);
-            if (!result &&
-                queueGraphics != queuePresentation)
-                result = vkQueueWaitIdle(queuePresentation);
-            if (result) {
-                outStream << std::format("Failed to wait for the queue to be idle.\nError code: {}", int32_t(result)) << std::endl;
-                return result;
-            }
-
+            // Frames already enqueued keep rendering to and presenting from the old swapchain, which is destroyed
+            // together with its image views and whatever the callbacks defer once those frames have finished.
+            retiredSwapchains.push_back({
+                .swapchain = swapchain,
+                .imageViews = std::move(swapchainImageViews),
+                .timelineValue = timelines[timelineGraphics].valueEnqueued,
+                .presentCount = presentCount });
+            pRetiringSwapchain = &retiredSwapchains.back();
             for (auto& i : callbacksDestroySwapchain) i();
-
-            for (auto& i : swapchainImageViews)
-                if (i)
-                    vkDestroyImageView(device, i, nullptr);
+            pRetiringSwapchain = nullptr;
             swapchainImageViews.resize(0);
 
-            if (result = createSwapchainInternal())
+            result_t result = createSwapchainInternal();
+            swapchainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+            if (result)
                 return result;
 
             for (auto& i : callbacksCreateSwapchain) i();
@@ -706,6 +1740,81 @@ namespace Vulkan {
         std::vector<void(*)()> callbacksCreateSwapchain;
         std::vector<void(*)()> callbacksDestroySwapchain;
 
+    // Swapchain Retirement
+    private:
+        struct RetiredSwapchain {
+            VkSwapchainKHR swapchain;
+            std::vector<VkImageView> imageViews;
+            uint64_t timelineValue;
+            // Presents recorded when the swapchain was retired.
+            uint64_t presentCount;
+            std::vector<std::function<void()>> deferredDestructions;
+        };
+        struct PresentFence {
+            VkSwapchainKHR swapchain;
+            VkFence fence;
+        };
+        std::deque<RetiredSwapchain> retiredSwapchains;
+        RetiredSwapchain* pRetiringSwapchain = nullptr;
+        // Signaled when the presentation engine is done with an image, only with VK_EXT_swapchain_maintenance1.
+        std::deque<PresentFence> presentFences;
+        bool swapchainMaintenance1Enabled = false;
+
+        void destroyRetiredSwapchain(RetiredSwapchain& retired) {
+            for (auto& i : retired.deferredDestructions) i();
+            for (auto& i : retired.imageViews)
+                if (i)
+                    vkDestroyImageView(device, i, HostAllocator::pCallbacks);
+            if (retired.swapchain)
+                vkDestroySwapchainKHR(device, retired.swapchain, HostAllocator::pCallbacks);
+        }
+
+        // With present fences, a present is pending until its fence signals. Without them, nothing tells when the
+        // presentation engine has waited on the semaphores of the last presents to a retired swapchain, but an
+        // image is acquired again only after its previous present has been processed, and a queue processes its
+        // presents in order. Once the newer swapchain has been presented to more times than it has images, one of
+        // those acquires has returned an image already presented to it, so every present queued before that one,
+        // including those to the retired swapchain, has been processed.
+        bool isPresentPending(const RetiredSwapchain& retired) const {
+            if (!swapchainMaintenance1Enabled)
+                return retired.swapchain &&
+                    presentCount <= retired.presentCount + swapchainImages.size();
+            for (auto& i : presentFences)
+                if (i.swapchain == retired.swapchain)
+                    return true;
+            return false;
+        }
+
+    public:
+        bool isSwapchainMaintenance1Enabled() const { return swapchainMaintenance1Enabled; }
+
+        // Called from callbacksDestroySwapchain: defers destroying objects that frames in flight may still use
+        // until the swapchain being retired is destroyed. Outside of a recreation, destroys immediately.
+        void deferDestruction(std::function<void()> destruction) {
+            if (pRetiringSwapchain)
+                pRetiringSwapchain->deferredDestructions.push_back(std::move(destruction));
+            else
+                destruction();
+        }
+
+        // Destroys retired swapchains whose last frame has finished on the graphics queue and whose presents have
+        // been processed, see isPresentPending(). Called by swapImage().
+        void collectRetiredSwapchains() {
+            while (presentFences.size() &&
+                vkGetFenceStatus(device, presentFences.front().fence) == VK_SUCCESS) {
+                syncObjectPool.recycleFence(presentFences.front().fence);
+                presentFences.pop_front();
+            }
+            while (retiredSwapchains.size()) {
+                RetiredSwapchain& retired = retiredSwapchains.front();
+                if (!isTimelineValueReached(timelineGraphics, retired.timelineValue) ||
+                    isPresentPending(retired))
+                    break;
+                destroyRetiredSwapchain(retired);
+                retiredSwapchains.pop_front();
+            }
+        }
+
     public:
         void pushCallbackCreateSwapchain(void(*function)()) {
             callbacksCreateSwapchain.push_back(function);
@@ -723,14 +1832,27 @@ namespace Vulkan {
 
     public:
         void terminate() {
-            this->~GraphicsBase();
+            destroyObjects();
             instance = VK_NULL_HANDLE;
             physicalDevice = VK_NULL_HANDLE;
             device = VK_NULL_HANDLE;
+            queueGraphics = VK_NULL_HANDLE;
+            queuePresentation = VK_NULL_HANDLE;
+            queueCompute = VK_NULL_HANDLE;
+            queueTransfer = VK_NULL_HANDLE;
             surface = VK_NULL_HANDLE;
             swapchain = VK_NULL_HANDLE;
             swapchainImages.resize(0);
             swapchainImageViews.resize(0);
+            swapchainImageTimelineValues.resize(0);
+            headless = false;
+            headlessReadbackEnabled = false;
+            headlessImages.clear();
+            headlessCommandPool = VK_NULL_HANDLE;
+            retiredSwapchains.clear();
+            presentFences.clear();
+            for (auto& i : timelines)
+                i = {};
             swapchainCreateInfo = {};
             debugUtilsMessenger = VK_NULL_HANDLE;
         }
@@ -741,25 +1863,630 @@ namespace Vulkan {
     public:
         uint32_t getCurrentImageIndex() const { return currentImageIndex; }
         result_t swapImage(VkSemaphore semaphoreImageIsAvailable) {
-            if (swapchainCreateInfo.oldSwapchain &&
-                swapchainCreateInfo.oldSwapchain != swapchain) {
-                vkDestroySwapchainKHR(device, swapchainCreateInfo.oldSwapchain, nullptr);
-                swapchainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+            cpuZone("GraphicsBase::swapImage");
+            if (headless) {
+                collectRetiredSwapchains();
+                currentImageIndex = (currentImageIndex + 1) % uint32_t(swapchainImages.size());
+                // Nothing to acquire, an empty batch signals the semaphore for the submission that renders the frame.
+                if (semaphoreImageIsAvailable)
+                    return enqueueSubmit(timelineGraphics, VK_NULL_HANDLE, {}, VK_NULL_HANDLE, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, semaphoreImageIsAvailable);
+                return VK_SUCCESS;
             }
-            switch (VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, semaphoreImageIsAvailable, VK_NULL_HANDLE, &currentImageIndex)) {
-            case VK_SUBOPTIMAL_KHR:
-            case VK_ERROR_OUT_OF_DATE_KHR:
-                return recreateSwapchain();
-            case VK_SUCCESS:
+            collectRetiredSwapchains();
+            // A suboptimal image has been acquired and is used as is, presentImage() then recreates the swapchain.
+            // An out-of-date swapchain acquires nothing, so acquisition is retried with the new one.
+            while (VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, semaphoreImageIsAvailable, VK_NULL_HANDLE, &currentImageIndex))
+                switch (result) {
+                case VK_SUBOPTIMAL_KHR:
+                    return VK_SUCCESS;
+                case VK_ERROR_OUT_OF_DATE_KHR:
+                    if (result_t resultRecreate = recreateSwapchain())
+                        return resultRecreate;
+                    break;
+                default:
+                    outStream << std::format("Failed to acquire the next image!\nError code: {}", int32_t(result)) << std::endl;
+                    return result;
+                }
+            return VK_SUCCESS;
+        }
+
+    // Headless
+    private:
+        // In headless mode swapchainImages and swapchainImageViews are owned by GraphicsBase.
+        struct HeadlessImage {
+            VkDeviceMemory memory = VK_NULL_HANDLE;
+            VkBuffer readbackBuffer = VK_NULL_HANDLE;
+            VkDeviceMemory readbackMemory = VK_NULL_HANDLE;
+            const void* pReadbackData = nullptr;
+            // Recorded once, copies the image into readbackBuffer.
+            VkCommandBuffer commandBufferReadback = VK_NULL_HANDLE;
+            uint64_t readbackTimelineValue = 0;
+        };
+        bool headless = false;
+        bool headlessReadbackEnabled = false;
+        std::vector<HeadlessImage> headlessImages;
+        VkCommandPool headlessCommandPool = VK_NULL_HANDLE;
+
+        result_t createHeadlessImage(uint32_t index) {
+            HeadlessImage& headlessImage = headlessImages[index];
+            VkImageCreateInfo imageCreateInfo = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+                .imageType = VK_IMAGE_TYPE_2D,
+                .format = swapchainCreateInfo.imageFormat,
+                .extent = { swapchainCreateInfo.imageExtent.width, swapchainCreateInfo.imageExtent.height, 1 },
+                .mipLevels = 1,
+                .arrayLayers = 1,
+                .samples = VK_SAMPLE_COUNT_1_BIT,
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = swapchainCreateInfo.imageUsage,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+            };
+            if (result_t result = vkCreateImage(device, &imageCreateInfo, HostAllocator::pCallbacks, &swapchainImages[index])) {
+                outStream << std::format("Failed to create a headless image!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            VkMemoryRequirements memoryRequirements;
+            vkGetImageMemoryRequirements(device, swapchainImages[index], &memoryRequirements);
+            VkMemoryAllocateInfo memoryAllocateInfo = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                .allocationSize = memoryRequirements.size,
+                .memoryTypeIndex = findMemoryTypeIndex(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+            };
+            if (memoryAllocateInfo.memoryTypeIndex == UINT32_MAX)
+                memoryAllocateInfo.memoryTypeIndex = findMemoryTypeIndex(memoryRequirements.memoryTypeBits, 0);
+            if (result_t result = vkAllocateMemory(device, &memoryAllocateInfo, HostAllocator::pCallbacks, &headlessImage.memory)) {
+                outStream << std::format("Failed to allocate memory for a headless image!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            if (result_t result = vkBindImageMemory(device, swapchainImages[index], headlessImage.memory, 0)) {
+                outStream << std::format("Failed to bind memory to a headless image!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            VkImageViewCreateInfo imageViewCreateInfo = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+                .image = swapchainImages[index],
+                .viewType = VK_IMAGE_VIEW_TYPE_2D,
+                .format = swapchainCreateInfo.imageFormat,
+                .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+            };
+            if (result_t result = vkCreateImageView(device, &imageViewCreateInfo, HostAllocator::pCallbacks, &swapchainImageViews[index])) {
+                outStream << std::format("Failed to create a headless image view!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            return headlessReadbackEnabled ? createHeadlessReadback(index) : VK_SUCCESS;
+        }
+
+        result_t createHeadlessReadback(uint32_t index) {
+            HeadlessImage& headlessImage = headlessImages[index];
+            VkExtent2D extent = swapchainCreateInfo.imageExtent;
+            VkBufferCreateInfo bufferCreateInfo = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+                .size = VkDeviceSize(extent.width) * extent.height * 4,
+                .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+            };
+            if (result_t result = vkCreateBuffer(device, &bufferCreateInfo, HostAllocator::pCallbacks, &headlessImage.readbackBuffer)) {
+                outStream << std::format("Failed to create a readback buffer!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            VkMemoryRequirements memoryRequirements;
+            vkGetBufferMemoryRequirements(device, headlessImage.readbackBuffer, &memoryRequirements);
+            VkMemoryAllocateInfo memoryAllocateInfo = {
+                .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+                .allocationSize = memoryRequirements.size,
+                .memoryTypeIndex = findMemoryTypeIndex(memoryRequirements.memoryTypeBits,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT)
+            };
+            if (memoryAllocateInfo.memoryTypeIndex == UINT32_MAX)
+                memoryAllocateInfo.memoryTypeIndex = findMemoryTypeIndex(memoryRequirements.memoryTypeBits,
+                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            if (result_t result = vkAllocateMemory(device, &memoryAllocateInfo, HostAllocator::pCallbacks, &headlessImage.readbackMemory)) {
+                outStream << std::format("Failed to allocate memory for a readback buffer!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            if (result_t result = vkBindBufferMemory(device, headlessImage.readbackBuffer, headlessImage.readbackMemory, 0)) {
+                outStream << std::format("Failed to bind memory to a readback buffer!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            void* pData = nullptr;
+            if (result_t result = vkMapMemory(device, headlessImage.readbackMemory, 0, VK_WHOLE_SIZE, 0, &pData)) {
+                outStream << std::format("Failed to map the memory of a readback buffer!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            headlessImage.pReadbackData = pData;
+
+            VkCommandBufferAllocateInfo commandBufferAllocateInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = headlessCommandPool,
+                .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                .commandBufferCount = 1
+            };
+            if (result_t result = vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, &headlessImage.commandBufferReadback)) {
+                outStream << std::format("Failed to allocate a readback command buffer!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            VkCommandBufferBeginInfo beginInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO
+            };
+            vkBeginCommandBuffer(headlessImage.commandBufferReadback, &beginInfo);
+            // The semaphore signaled by rendering is waited at the transfer stage, which the barriers chain to.
+            VkImageMemoryBarrier imageMemoryBarrier = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+                .srcAccessMask = 0,
+                .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+                .oldLayout = headlessImageLayout,
+                .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .image = swapchainImages[index],
+                .subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+            };
+            vkCmdPipelineBarrier(headlessImage.commandBufferReadback, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+            VkBufferImageCopy region = {
+                .imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+                .imageExtent = { extent.width, extent.height, 1 }
+            };
+            vkCmdCopyImageToBuffer(headlessImage.commandBufferReadback, swapchainImages[index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                headlessImage.readbackBuffer, 1, &region);
+            imageMemoryBarrier.srcAccessMask = 0;
+            imageMemoryBarrier.dstAccessMask = 0;
+            imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            imageMemoryBarrier.newLayout = headlessImageLayout;
+            VkBufferMemoryBarrier bufferMemoryBarrier = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+                .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+                .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+                .buffer = headlessImage.readbackBuffer,
+                .size = VK_WHOLE_SIZE
+            };
+            vkCmdPipelineBarrier(headlessImage.commandBufferReadback, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                0, nullptr, 1, &bufferMemoryBarrier, 1, &imageMemoryBarrier);
+            if (result_t result = vkEndCommandBuffer(headlessImage.commandBufferReadback)) {
+                outStream << std::format("Failed to end a readback command buffer!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            return VK_SUCCESS;
+        }
+
+        result_t createHeadlessImages() {
+            uint32_t imageCount = swapchainCreateInfo.minImageCount;
+            headlessImages.resize(imageCount);
+            swapchainImages.resize(imageCount);
+            swapchainImageViews.resize(imageCount);
+            for (uint32_t i = 0; i < imageCount; i++)
+                if (result_t result = createHeadlessImage(i))
+                    return result;
+            swapchainImageTimelineValues.assign(imageCount, 0);
+            // swapImage() advances the index first, so the first frame renders to image 0.
+            currentImageIndex = imageCount - 1;
+            return VK_SUCCESS;
+        }
+
+        // Replaces the images the way recreateSwapchain() replaces a swapchain: the old ones are retired with
+        // whatever the callbacks defer, and destroyed once the frames enqueued so far have finished.
+        result_t recreateHeadlessSwapchain() {
+            retiredSwapchains.push_back({
+                .swapchain = VK_NULL_HANDLE,
+                .imageViews = std::move(swapchainImageViews),
+                .timelineValue = timelines[timelineGraphics].valueEnqueued ,
+                .presentCount = presentCount });
+            pRetiringSwapchain = &retiredSwapchains.back();
+            for (auto& i : callbacksDestroySwapchain) i();
+            deferDestruction([this, images = std::move(swapchainImages), retiredImages = std::move(headlessImages)] {
+                for (size_t i = 0; i < images.size(); i++) {
+                    vkDestroyImage(device, images[i], HostAllocator::pCallbacks);
+                    vkFreeMemory(device, retiredImages[i].memory, HostAllocator::pCallbacks);
+                    if (retiredImages[i].readbackBuffer)
+                        vkDestroyBuffer(device, retiredImages[i].readbackBuffer, HostAllocator::pCallbacks),
+                        vkFreeMemory(device, retiredImages[i].readbackMemory, HostAllocator::pCallbacks),
+                        vkFreeCommandBuffers(device, headlessCommandPool, 1, &retiredImages[i].commandBufferReadback);
+                }
+            });
+            pRetiringSwapchain = nullptr;
+            swapchainImageViews.clear();
+            swapchainImages.clear();
+            headlessImages.clear();
+
+            if (result_t result = createHeadlessImages())
+                return result;
+            for (auto& i : callbacksCreateSwapchain) i();
+            return VK_SUCCESS;
+        }
+
+        void destroyHeadlessImages() {
+            for (size_t i = 0; i < headlessImages.size(); i++) {
+                if (swapchainImageViews[i])
+                    vkDestroyImageView(device, swapchainImageViews[i], HostAllocator::pCallbacks);
+                if (swapchainImages[i])
+                    vkDestroyImage(device, swapchainImages[i], HostAllocator::pCallbacks);
+                if (headlessImages[i].memory)
+                    vkFreeMemory(device, headlessImages[i].memory, HostAllocator::pCallbacks);
+                if (headlessImages[i].readbackBuffer)
+                    vkDestroyBuffer(device, headlessImages[i].readbackBuffer, HostAllocator::pCallbacks);
+                if (headlessImages[i].readbackMemory)
+                    vkFreeMemory(device, headlessImages[i].readbackMemory, HostAllocator::pCallbacks);
+            }
+            if (headlessCommandPool)
+                vkDestroyCommandPool(device, headlessCommandPool, HostAllocator::pCallbacks);
+            headlessCommandPool = VK_NULL_HANDLE;
+            headlessImages.clear();
+            swapchainImages.clear();
+            swapchainImageViews.clear();
+        }
+
+    public:
+        // The layout rendering leaves headless images in, by default that of render passes written for a swapchain.
+        VkImageLayout headlessImageLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+        bool isHeadless() const { return headless; }
+        bool isHeadlessReadbackEnabled() const { return headlessReadbackEnabled; }
+
+        // Stands in for createSwapchain() when there is no surface: imageCount offscreen images of format are
+        // cycled through by swapImage() and presentImage(), and their views are returned as swapchain image views.
+        // With readback, presentImage() also copies each frame into host memory, which requires a format of four bytes per texel.
+        result_t createHeadlessSwapchain(VkExtent2D extent, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, uint32_t imageCount = 3, bool readback = false) {
+            if (readback &&
+                format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB &&
+                format != VK_FORMAT_B8G8R8A8_UNORM && format != VK_FORMAT_B8G8R8A8_SRGB) {
+                outStream << std::format("Headless readback requires a four-component 8-bit format, readback is disabled.") << std::endl;
+                readback = false;
+            }
+            headless = true;
+            headlessReadbackEnabled = readback;
+            swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+            swapchainCreateInfo.minImageCount = imageCount;
+            swapchainCreateInfo.imageFormat = format;
+            swapchainCreateInfo.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
+            swapchainCreateInfo.imageExtent = extent;
+            swapchainCreateInfo.imageArrayLayers = 1;
+            swapchainCreateInfo.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+            swapchainCreateInfo.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+            swapchainCreateInfo.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+
+            if (readback) {
+                VkCommandPoolCreateInfo commandPoolCreateInfo = {
+                    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                    .queueFamilyIndex = queueFamilyIndexGraphics
+                };
+                if (result_t result = vkCreateCommandPool(device, &commandPoolCreateInfo, HostAllocator::pCallbacks, &headlessCommandPool)) {
+                    outStream << std::format("Failed to create the headless command pool!\nError code: {}", int32_t(result)) << std::endl;
+                    return result;
+                }
+            }
+            if (result_t result = createHeadlessImages())
+                return result;
+            for (auto& i : callbacksCreateSwapchain) i();
+            return VK_SUCCESS;
+        }
+
+        // Waits for the copy made by the last presentImage() of the image, returns nullptr if there is none.
+        // Texels are tightly packed in the image format, rows top to bottom.
+        const void* getHeadlessReadback(uint32_t imageIndex) {
+            if (!headlessReadbackEnabled ||
+                !headlessImages[imageIndex].readbackTimelineValue ||
+                waitTimeline(timelineGraphics, headlessImages[imageIndex].readbackTimelineValue))
+                return nullptr;
+            return headlessImages[imageIndex].pReadbackData;
+        }
+
+    // Frames In Flight
+    private:
+        uint32_t maxFramesInFlight = 2;
+        uint32_t currentFrameIndex = 0;
+        std::vector<uint64_t> swapchainImageTimelineValues;
+
+    public:
+        uint32_t getMaxFramesInFlight() const { return maxFramesInFlight; }
+        uint32_t getCurrentFrameIndex() const { return currentFrameIndex; }
+
+        void setMaxFramesInFlight(uint32_t count) {
+            maxFramesInFlight = glm::clamp(count, 1u, 8u);
+            currentFrameIndex = 0;
+        }
+
+        void advanceFrame() {
+            currentFrameIndex = (currentFrameIndex + 1) % maxFramesInFlight;
+            submitsSavedLastFrame = submitsSavedThisFrame;
+            submitsSavedThisFrame = 0;
+            syncObjectPool.newFrame();
+            memoryAllocator.updateBudget();
+            pipelineCache.newFrame();
+        }
+
+        // Waits until the graphics submission that last rendered to the current swapchain image has finished.
+        result_t waitForSwapchainImage() {
+            return waitTimeline(timelineGraphics, swapchainImageTimelineValues[currentImageIndex]);
+        }
+
+        // Records the graphics timeline value which releases the current swapchain image.
+        void setSwapchainImageTimelineValue(uint64_t value) {
+            swapchainImageTimelineValues[currentImageIndex] = value;
+        }
+
+    // Timeline
+    public:
+        enum TimelineQueue : uint32_t {
+            timelineGraphics,
+            timelineCompute,
+            timelinePresentation,
+            timelineTransfer,
+            timelineCount
+        };
+        struct TimelineWait {
+            uint32_t timeline;
+            uint64_t value;
+            VkPipelineStageFlags dstStageMask = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        };
+
+    private:
+        // Each queue owns a monotonically increasing timeline. Without VK_KHR_timeline_semaphore (core in 1.2),
+        // every submission gets a recycled binary fence and the counter value is derived from signaled fences.
+        // Submissions are first recorded as batches and each queue's batches go out in a single vkQueueSubmit
+        // when the timeline is flushed; valueEnqueued runs ahead of valueSubmitted until then.
+        struct SubmitBatch {
+            VkCommandBuffer commandBuffer;
+            std::vector<VkSemaphore> waitSemaphores;
+            std::vector<uint64_t> waitValues;
+            std::vector<VkPipelineStageFlags> waitDstStages;
+            VkSemaphore signalSemaphores[2];
+            uint64_t signalValues[2];
+            uint32_t signalCount;
+            VkTimelineSemaphoreSubmitInfo timelineSemaphoreSubmitInfo;
+        };
+        struct Timeline {
+            VkSemaphore semaphore = VK_NULL_HANDLE;
+            uint64_t valueEnqueued = 0;
+            uint64_t valueSubmitted = 0;
+            uint64_t valueCompleted = 0;
+            std::deque<std::pair<uint64_t, VkFence>> pendingFences;
+            std::vector<SubmitBatch> batches;
+            uint32_t batchCount = 0;
+            std::vector<VkSubmitInfo> submitInfos;
+        } timelines[timelineCount];
+        uint32_t submitsSavedThisFrame = 0;
+        uint32_t submitsSavedLastFrame = 0;
+        bool timelineSemaphoreEnabled = false;
+
+        VkQueue getTimelineQueue(uint32_t timeline) const {
+            switch (timeline) {
+            case timelineGraphics: return queueGraphics;
+            case timelineCompute: return queueCompute;
+            case timelineTransfer: return queueTransfer;
+            default: return queuePresentation;
+            }
+        }
+
+        result_t createTimelines() {
+            if (!timelineSemaphoreEnabled)
                 return VK_SUCCESS;
-            default:
-                outStream << std::format("Failed to acquire the next image!\nError code: {}", int32_t(result)) << std::endl;
+            VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                .initialValue = 0
+            };
+            VkSemaphoreCreateInfo semaphoreCreateInfo = {
+                .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+                .pNext = &semaphoreTypeCreateInfo
+            };
+            for (auto& i : timelines)
+                if (result_t result = vkCreateSemaphore(device, &semaphoreCreateInfo, HostAllocator::pCallbacks, &i.semaphore)) {
+                    outStream << std::format("Failed to create a timeline semaphore!\nError code: {}", int32_t(result)) << std::endl;
+                    return result;
+                }
+            return VK_SUCCESS;
+        }
+
+        result_t updateTimeline(uint32_t timeline) {
+            Timeline& t = timelines[timeline];
+            if (timelineSemaphoreEnabled) {
+                VkResult result = vkGetSemaphoreCounterValue(device, t.semaphore, &t.valueCompleted);
+                if (result)
+                    outStream << std::format("Failed to get the counter value of the timeline semaphore!\nError code: {}", int32_t(result)) << std::endl;
                 return result;
             }
+            while (t.pendingFences.size()) {
+                auto [value, fence] = t.pendingFences.front();
+                VkResult result = vkGetFenceStatus(device, fence);
+                if (result == VK_NOT_READY)
+                    break;
+                if (result) {
+                    outStream << std::format("Failed to retire a timeline fence!\nError code: {}", int32_t(result)) << std::endl;
+                    return result;
+                }
+                if (VkResult resultRecycle = syncObjectPool.recycleFence(fence))
+                    return resultRecycle;
+                t.valueCompleted = value;
+                t.pendingFences.pop_front();
+            }
+            return VK_SUCCESS;
+        }
+
+    public:
+        bool isTimelineSemaphoreEnabled() const { return timelineSemaphoreEnabled; }
+        uint64_t getTimelineValueSubmitted(uint32_t timeline) const { return timelines[timeline].valueSubmitted; }
+        uint64_t getTimelineValueEnqueued(uint32_t timeline) const { return timelines[timeline].valueEnqueued; }
+        // vkQueueSubmit calls avoided by flushing batches together, counted per frame (reset by advanceFrame()).
+        uint32_t getSubmitsSavedThisFrame() const { return submitsSavedThisFrame; }
+        uint32_t getSubmitsSavedLastFrame() const { return submitsSavedLastFrame; }
+        // The cached completed value, refreshed by isTimelineValueReached() and waitTimeline().
+        uint64_t getTimelineValueCompleted(uint32_t timeline) const { return timelines[timeline].valueCompleted; }
+
+        bool isTimelineValueReached(uint32_t timeline, uint64_t value) {
+            if (value <= timelines[timeline].valueCompleted)
+                return true;
+            updateTimeline(timeline);
+            return value <= timelines[timeline].valueCompleted;
+        }
+
+        result_t waitTimeline(uint32_t timeline, uint64_t value, uint64_t timeout = UINT64_MAX) {
+            cpuZone("GraphicsBase::waitTimeline");
+            Timeline& t = timelines[timeline];
+            if (value <= t.valueCompleted)
+                return VK_SUCCESS;
+            if (value > t.valueEnqueued) {
+                outStream << std::format("Waiting for timeline value {} which has never been submitted!", value) << std::endl;
+                return VK_RESULT_MAX_ENUM;
+            }
+            if (value > t.valueSubmitted)
+                if (result_t result = flushSubmits(timeline))
+                    return result;
+            VkResult result;
+            if (timelineSemaphoreEnabled) {
+                VkSemaphoreWaitInfo waitInfo = {
+                    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                    .semaphoreCount = 1,
+                    .pSemaphores = &t.semaphore,
+                    .pValues = &value
+                };
+                result = vkWaitSemaphores(device, &waitInfo, timeout);
+                if (!result)
+                    t.valueCompleted = std::max(t.valueCompleted, value);
+            } else {
+                auto i = t.pendingFences.begin();
+                while (i->first < value) ++i;
+                result = vkWaitForFences(device, 1, &i->second, false, timeout);
+                if (!result)
+                    result = updateTimeline(timeline);
+            }
+            if (result && result != VK_TIMEOUT)
+                outStream << std::format("Failed to wait for the timeline!\nError code: {}", int32_t(result)) << std::endl;
+            return result;
+        }
+
+        // Enqueues commandBuffer for the queue of timeline; the batch will signal the next value of the timeline,
+        // which is written to *pSignalValue, once flushSubmits() sends it. Waits on timeline values that have
+        // already been reached are dropped; in the binary fallback, all waits are resolved on the CPU.
+        result_t enqueueSubmit(uint32_t timeline, VkCommandBuffer commandBuffer, ArrayRef<const TimelineWait> timelineWaits = {},
+            VkSemaphore semaphoreToWait = VK_NULL_HANDLE, VkPipelineStageFlags semaphoreWaitDstStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            VkSemaphore semaphoreToSignal = VK_NULL_HANDLE, uint64_t* pSignalValue = nullptr) {
+            if (!getTimelineQueue(timeline)) {
+                outStream << std::format("Enqueueing a submission for timeline {} whose queue has not been created!", timeline) << std::endl;
+                return VK_RESULT_MAX_ENUM;
+            }
+            // Resolved before the batch is reserved, since waiting may flush the batches of this very timeline.
+            if (!timelineSemaphoreEnabled)
+                for (auto& i : timelineWaits)
+                    if (result_t result = waitTimeline(i.timeline, i.value))
+                        return result;
+            Timeline& t = timelines[timeline];
+            if (t.batchCount == t.batches.size())
+                t.batches.emplace_back();
+            SubmitBatch& batch = t.batches[t.batchCount];
+            batch.commandBuffer = commandBuffer;
+            batch.waitSemaphores.clear();
+            batch.waitValues.clear();
+            batch.waitDstStages.clear();
+            if (timelineSemaphoreEnabled)
+                for (auto& i : timelineWaits) {
+                    if (isTimelineValueReached(i.timeline, i.value))
+                        continue;
+                    size_t j = 0;
+                    while (j < batch.waitSemaphores.size() && batch.waitSemaphores[j] != timelines[i.timeline].semaphore) j++;
+                    if (j == batch.waitSemaphores.size())
+                        batch.waitSemaphores.push_back(timelines[i.timeline].semaphore),
+                        batch.waitValues.push_back(0),
+                        batch.waitDstStages.push_back(0);
+                    batch.waitValues[j] = std::max(batch.waitValues[j], i.value);
+                    batch.waitDstStages[j] |= i.dstStageMask;
+                }
+            if (semaphoreToWait)
+                batch.waitSemaphores.push_back(semaphoreToWait),
+                batch.waitValues.push_back(0),
+                batch.waitDstStages.push_back(semaphoreWaitDstStage);
+
+            uint64_t signalValue = t.valueEnqueued + 1;
+            batch.signalCount = 0;
+            if (timelineSemaphoreEnabled)
+                batch.signalSemaphores[batch.signalCount] = t.semaphore,
+                batch.signalValues[batch.signalCount++] = signalValue;
+            if (semaphoreToSignal)
+                batch.signalSemaphores[batch.signalCount] = semaphoreToSignal,
+                batch.signalValues[batch.signalCount++] = 0;
+
+            t.batchCount++;
+            t.valueEnqueued = signalValue;
+            if (pSignalValue)
+                *pSignalValue = signalValue;
+            return VK_SUCCESS;
+        }
+
+        // Sends all batches enqueued for timeline with a single vkQueueSubmit.
+        result_t flushSubmits(uint32_t timeline) {
+            cpuZone("GraphicsBase::flushSubmits");
+            if (!getTimelineQueue(timeline)) {
+                outStream << std::format("Flushing timeline {} whose queue has not been created!", timeline) << std::endl;
+                return VK_RESULT_MAX_ENUM;
+            }
+            Timeline& t = timelines[timeline];
+            if (!t.batchCount)
+                return VK_SUCCESS;
+            t.submitInfos.resize(t.batchCount);
+            for (uint32_t i = 0; i < t.batchCount; i++) {
+                SubmitBatch& batch = t.batches[i];
+                batch.timelineSemaphoreSubmitInfo = {
+                    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+                    .waitSemaphoreValueCount = uint32_t(batch.waitValues.size()),
+                    .pWaitSemaphoreValues = batch.waitValues.data(),
+                    .signalSemaphoreValueCount = batch.signalCount,
+                    .pSignalSemaphoreValues = batch.signalValues
+                };
+                t.submitInfos[i] = {
+                    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                    .pNext = timelineSemaphoreEnabled ? &batch.timelineSemaphoreSubmitInfo : nullptr,
+                    .waitSemaphoreCount = uint32_t(batch.waitSemaphores.size()),
+                    .pWaitSemaphores = batch.waitSemaphores.data(),
+                    .pWaitDstStageMask = batch.waitDstStages.data(),
+                    .commandBufferCount = uint32_t(bool(batch.commandBuffer)),
+                    .pCommandBuffers = &batch.commandBuffer,
+                    .signalSemaphoreCount = batch.signalCount,
+                    .pSignalSemaphores = batch.signalSemaphores
+                };
+            }
+            VkFence fence = VK_NULL_HANDLE;
+            if (!timelineSemaphoreEnabled)
+                if (result_t result = syncObjectPool.acquireFence(fence))
+                    return result;
+            uint32_t batchCount = t.batchCount;
+            t.batchCount = 0;
+            if (VkResult result = vkQueueSubmit(getTimelineQueue(timeline), batchCount, t.submitInfos.data(), fence)) {
+                outStream << std::format("Failed to submit the command buffer!\nError code: {}", int32_t(result)) << std::endl;
+                if (fence)
+                    syncObjectPool.recycleFence(fence);
+                t.valueEnqueued = t.valueSubmitted;
+                return result;
+            }
+            if (fence)
+                t.pendingFences.emplace_back(t.valueEnqueued, fence);
+            t.valueSubmitted = t.valueEnqueued;
+            submitsSavedThisFrame += batchCount - 1;
+            return VK_SUCCESS;
+        }
+
+        // Skips the timelines of queues which have not been created.
+        result_t flushSubmits() {
+            for (uint32_t i = 0; i < timelineCount; i++)
+                if (getTimelineQueue(i))
+                    if (result_t result = flushSubmits(i))
+                        return result;
+            return VK_SUCCESS;
+        }
+
+        // Enqueues and flushes immediately, together with whatever has been enqueued for the same queue.
+        result_t submitTimelined(uint32_t timeline, VkCommandBuffer commandBuffer, ArrayRef<const TimelineWait> timelineWaits = {},
+            VkSemaphore semaphoreToWait = VK_NULL_HANDLE, VkPipelineStageFlags semaphoreWaitDstStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            VkSemaphore semaphoreToSignal = VK_NULL_HANDLE, uint64_t* pSignalValue = nullptr) {
+            if (result_t result = enqueueSubmit(timeline, commandBuffer, timelineWaits, semaphoreToWait, semaphoreWaitDstStage, semaphoreToSignal, pSignalValue))
+                return result;
+            return flushSubmits(timeline);
         }
 
     public:
         result_t submitCommandBufferGraphics(VkSubmitInfo& submitInfo, VkFence fence = VK_NULL_HANDLE) const {
+            cpuZone("GraphicsBase::submitCommandBufferGraphics");
             submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
             VkResult result = vkQueueSubmit(queueGraphics, 1, &submitInfo, fence);
             if (result)
@@ -809,6 +2536,7 @@ namespace Vulkan {
         }
 
         result_t presentImage(VkPresentInfoKHR& presentInfo) {
+            cpuZone("GraphicsBase::presentImage");
             presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
             switch (result_t result = vkQueuePresentKHR(queuePresentation, &presentInfo)) {
             case VK_SUBOPTIMAL_KHR:
@@ -823,6 +2551,8 @@ namespace Vulkan {
         }
 
         result_t presentImage(VkSemaphore semaphoreRenderingIsOver = VK_NULL_HANDLE) {
+            if (headless)
+                return presentHeadlessImage(semaphoreRenderingIsOver);
             VkPresentInfoKHR presentInfo = {
                 .swapchainCount = 1,
                 .pSwapchains = &swapchain,
@@ -831,9 +2561,137 @@ namespace Vulkan {
             if (semaphoreRenderingIsOver)
                 presentInfo.waitSemaphoreCount = 1,
                 presentInfo.pWaitSemaphores = &semaphoreRenderingIsOver;
+            VkFence presentFence = VK_NULL_HANDLE;
+            VkSwapchainPresentFenceInfoEXT presentFenceInfo = {
+                .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_PRESENT_FENCE_INFO_EXT,
+                .swapchainCount = 1,
+                .pFences = &presentFence
+            };
+            if (swapchainMaintenance1Enabled &&
+                !syncObjectPool.acquireFence(presentFence)) {
+                presentInfo.pNext = &presentFenceInfo;
+                presentFences.push_back({ swapchain, presentFence });
+            }
+            uint64_t presentId = presentCount + 1;
+            VkPresentIdKHR presentIdInfo = {
+                .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+                .pNext = presentInfo.pNext,
+                .swapchainCount = 1,
+                .pPresentIds = &presentId
+            };
+            if (presentWaitEnabled)
+                presentInfo.pNext = &presentIdInfo;
+            recordPresent();
             return presentImage(presentInfo);
         }
 
+    private:
+        // The semaphore is waited on by the readback copy, or without readback, by an empty batch, so it can be reused.
+        result_t presentHeadlessImage(VkSemaphore semaphoreRenderingIsOver) {
+            HeadlessImage& headlessImage = headlessImages[currentImageIndex];
+            if (headlessReadbackEnabled || semaphoreRenderingIsOver) {
+                uint64_t value = 0;
+                if (result_t result = submitTimelined(timelineGraphics, headlessImage.commandBufferReadback, {},
+                    semaphoreRenderingIsOver, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_NULL_HANDLE, &value))
+                    return result;
+                // The image may not be rendered to again before it has been copied.
+                swapchainImageTimelineValues[currentImageIndex] = value;
+                if (headlessReadbackEnabled)
+                    headlessImage.readbackTimelineValue = value;
+            }
+            recordPresent();
+            return VK_SUCCESS;
+        }
+
+    // Frame Pacing
+    public:
+        struct PresentTiming {
+            // In milliseconds, averaged over the presents completed since the previous measurement.
+            double presentToPresent = 0;
+            double submitToPresent = 0;
+            // False if the times are estimated from the graphics timeline instead of VK_KHR_present_wait.
+            bool measuredByPresentWait = false;
+        };
+
+    private:
+        static constexpr uint32_t presentRecordCount = 16;
+        struct PresentRecord {
+            VkSwapchainKHR swapchain;
+            uint64_t timelineValue;
+            std::chrono::steady_clock::time_point timeQueued;
+        };
+        PresentRecord presentRecords[presentRecordCount] = {};
+        // Presents made through presentImage(VkSemaphore) are numbered from 1, the number is also the present ID.
+        uint64_t presentCount = 0;
+        uint64_t presentCountCompleted = 0;
+        std::chrono::steady_clock::time_point timeLastPresentCompleted;
+        uint32_t maxQueuedPresents = 0;
+        PresentTiming presentTiming;
+        bool presentWaitEnabled = false;
+        PFN_vkWaitForPresentKHR vkWaitForPresent = nullptr;
+
+        void recordPresent() {
+            presentCount++;
+            presentRecords[presentCount % presentRecordCount] = {
+                swapchain,
+                timelines[timelineGraphics].valueEnqueued,
+                std::chrono::steady_clock::now()
+            };
+        }
+
+        // Waits for the present to reach the display, or with the fallback, for its rendering to finish.
+        result_t waitForPresentCompletion(uint64_t presentId, uint64_t timeout) {
+            PresentRecord& record = presentRecords[presentId % presentRecordCount];
+            bool byPresentWait = presentWaitEnabled && record.swapchain == swapchain;
+            VkResult result = byPresentWait ?
+                vkWaitForPresent(device, swapchain, presentId, timeout) :
+                VkResult(waitTimeline(timelineGraphics, record.timelineValue, timeout));
+            if (result)
+                return result;
+            auto now = std::chrono::steady_clock::now();
+            presentTiming.submitToPresent = std::chrono::duration<double, std::milli>(now - record.timeQueued).count();
+            if (presentCountCompleted)
+                presentTiming.presentToPresent =
+                    std::chrono::duration<double, std::milli>(now - timeLastPresentCompleted).count() / (presentId - presentCountCompleted);
+            presentTiming.measuredByPresentWait = byPresentWait;
+            presentCountCompleted = presentId;
+            timeLastPresentCompleted = now;
+            return VK_SUCCESS;
+        }
+
+    public:
+        bool isPresentWaitEnabled() const { return presentWaitEnabled; }
+        uint32_t getMaxQueuedPresents() const { return maxQueuedPresents; }
+        const PresentTiming& getPresentTiming() const { return presentTiming; }
+
+        // 0 disables pacing, presentation times are still measured.
+        void setMaxQueuedPresents(uint32_t count) {
+            maxQueuedPresents = std::min(count, presentRecordCount - 1);
+        }
+
+        // Call before recording a frame. Sleeps until no more than maxQueuedPresents presents are outstanding,
+        // so the frame is recorded as late as possible, then polls the newer presents for timing.
+        result_t paceFrame() {
+            cpuZone("GraphicsBase::paceFrame");
+            if (presentCount > presentRecordCount)
+                presentCountCompleted = std::max(presentCountCompleted, presentCount - presentRecordCount);
+            if (maxQueuedPresents &&
+                presentCount > presentCountCompleted + maxQueuedPresents)
+                switch (VkResult result = waitForPresentCompletion(presentCount - maxQueuedPresents, 1'000'000'000)) {
+                case VK_SUCCESS:
+                case VK_TIMEOUT:
+                case VK_SUBOPTIMAL_KHR:
+                case VK_ERROR_OUT_OF_DATE_KHR:
+                    break;
+                default:
+                    outStream << std::format("Failed to wait for the present!\nError code: {}", int32_t(result)) << std::endl;
+                    return result;
+                }
+            while (presentCountCompleted < presentCount &&
+                waitForPresentCompletion(presentCountCompleted + 1, 0) == VK_SUCCESS);
+            return VK_SUCCESS;
+        }
+
         public:
         result_t submitCommandBufferPresentation(VkCommandBuffer commandBuffer,
             VkSemaphore semaphoreRenderingIsOver = VK_NULL_HANDLE, VkSemaphore semaphoreOwnershipIsTransfered = VK_NULL_HANDLE, VkFence fence = VK_NULL_HANDLE) const {
@@ -876,35 +2734,6 @@ namespace Vulkan {
 
     inline GraphicsBase GraphicsBase::singleton;
 
-    template<typename T>
-    class ArrayRef {
-        T* const pArray = nullptr;
-        size_t count = 0;
-    public:
-        // 从空参数构造，count为0
-        ArrayRef() = default;
-        // 从单个对象构造，count为1
-        ArrayRef(T& data) :pArray(&data), count(1) {}
-        // 从顶级数组构造
-        template<size_t elementCount>
-        ArrayRef(T(&data)[elementCount]) : pArray(data), count(elementCount) {}
-        // 从指针和元素个数构造
-        ArrayRef(T* pData, size_t elementCount) :pArray(pData), count(elementCount) {}
-        // 复制构造，若T带const修饰，兼容从对应的无const修饰版本的arrayRef构造
-        // 24.01.07 修正因复制粘贴产生的typo：从pArray(&other)改为pArray(other.Pointer())
-        ArrayRef(const ArrayRef<std::remove_const_t<T>>& other) :pArray(other.pointer()), count(other.getCount()) {}
-        // Getter
-        T* pointer() const { return pArray; }
-        size_t getCount() const { return count; }
-        // Const Function
-        T& operator[](size_t index) const { return pArray[index]; }
-        T* begin() const { return pArray; }
-        T* end() const { return pArray + count; }
-        // Non-const Function
-        // 禁止复制/移动赋值
-        ArrayRef& operator=(const ArrayRef&) = delete;
-    };
-
     class Fence {
 
         VkFence handle = VK_NULL_HANDLE;
@@ -949,7 +2778,7 @@ namespace Vulkan {
         // Non-const Function
         result_t create(VkFenceCreateInfo& createInfo) {
             createInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-            VkResult result = vkCreateFence(GraphicsBase::getBase().getDevice(), &createInfo, nullptr, &handle);
+            VkResult result = vkCreateFence(GraphicsBase::getBase().getDevice(), &createInfo, HostAllocator::pCallbacks, &handle);
             if (result)
                 outStream << std::format("Failed to create a fence!\nError code: {}", int32_t(result)) << std::endl;
             return result;
@@ -979,7 +2808,7 @@ namespace Vulkan {
         // Non-const Function
         result_t create(VkSemaphoreCreateInfo& createInfo) {
             createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-            VkResult result = vkCreateSemaphore(GraphicsBase::getBase().getDevice(), &createInfo, nullptr, &handle);
+            VkResult result = vkCreateSemaphore(GraphicsBase::getBase().getDevice(), &createInfo, HostAllocator::pCallbacks, &handle);
             if (result)
                 outStream << std::format("Failed to create a semaphore!\nError code: {}", int32_t(result)) << std::endl;
             return result;
@@ -1031,6 +2860,16 @@ namespace Vulkan {
                 outStream << std::format("Failed to end a command buffer!\nError code: {}", int32_t(result)) << std::endl;
             return result;
         }
+
+        // For pipelines made with GraphicsPipelineCreateInfoPack::useDynamicViewportAndScissor().
+        // Sets the first viewport and scissor to cover area, e.g. the render area of the render pass.
+        void setViewportAndScissor(VkRect2D area, float minDepth = 0.f, float maxDepth = 1.f) const {
+            VkViewport viewport = {
+                float(area.offset.x), float(area.offset.y), float(area.extent.width), float(area.extent.height), minDepth, maxDepth
+            };
+            vkCmdSetViewport(handle, 0, 1, &viewport);
+            vkCmdSetScissor(handle, 0, 1, &area);
+        }
     };
 
     class CommandPool {
@@ -1074,7 +2913,7 @@ namespace Vulkan {
         // Non-const Function
         result_t create(VkCommandPoolCreateInfo& createInfo) {
             createInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-            VkResult result = vkCreateCommandPool(GraphicsBase::getBase().getDevice(), &createInfo, nullptr, &handle);
+            VkResult result = vkCreateCommandPool(GraphicsBase::getBase().getDevice(), &createInfo, HostAllocator::pCallbacks, &handle);
             if (result)
                 outStream << std::format("Failed to create a command pool!\nError code: {}", int32_t(result)) << std::endl;
             return result;
@@ -1099,9 +2938,15 @@ namespace Vulkan {
         defineHandleTypeOperator;
         defineAddressFunction;
 
+        // Called right before every render pass instance begins and right after it ends, e.g. by GpuProfiler.
+        inline static void(*callbackCmdBegin)(VkCommandBuffer, VkRenderPass) = nullptr;
+        inline static void(*callbackCmdEnd)(VkCommandBuffer, VkRenderPass) = nullptr;
+
         void cmdBegin(VkCommandBuffer commandBuffer, VkRenderPassBeginInfo& beginInfo, VkSubpassContents subpassContents = VK_SUBPASS_CONTENTS_INLINE) const {
             beginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
             beginInfo.renderPass = handle;
+            if (callbackCmdBegin)
+                callbackCmdBegin(commandBuffer, handle);
             vkCmdBeginRenderPass(commandBuffer, &beginInfo, subpassContents);
         }
 
@@ -1118,6 +2963,8 @@ namespace Vulkan {
                 .clearValueCount = uint32_t(clearValues.getCount()),
                 .pClearValues = clearValues.pointer()
             };
+            if (callbackCmdBegin)
+                callbackCmdBegin(commandBuffer, handle);
             vkCmdBeginRenderPass(commandBuffer, &beginInfo, subpassContents);
         }
 
@@ -1127,17 +2974,169 @@ namespace Vulkan {
 
         void cmdEnd(VkCommandBuffer commandBuffer) const {
             vkCmdEndRenderPass(commandBuffer);
+            if (callbackCmdEnd)
+                callbackCmdEnd(commandBuffer, handle);
         }
 
         result_t create(VkRenderPassCreateInfo& createInfo) {
             createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-            VkResult result = vkCreateRenderPass(GraphicsBase::getBase().getDevice(), &createInfo, nullptr, &handle);
+            VkResult result = vkCreateRenderPass(GraphicsBase::getBase().getDevice(), &createInfo, HostAllocator::pCallbacks, &handle);
             if (result)
                 outStream << std::format("Failed to create a render pass!\nError code: {}", int32_t(result)) << std::endl;
             return result;
         }
     };
 
+    // Buffers and images are bound to memory from GraphicsBase's MemoryAllocator, which is freed along with them.
+    // Memory is dedicated where the driver prefers it, as reported by VkMemoryDedicatedRequirements.
+    class Buffer {
+        VkBuffer handle = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation allocation;
+    public:
+        Buffer() = default;
+        Buffer(VkBufferCreateInfo& createInfo, VkMemoryPropertyFlags memoryProperties) {
+            create(createInfo, memoryProperties);
+        }
+        Buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties) {
+            create(size, usage, memoryProperties);
+        }
+        Buffer(Buffer&& other) noexcept {
+            moveHandle;
+            allocation = other.allocation;
+            other.allocation = {};
+        }
+        ~Buffer() {
+            destroyHandleBy(vkDestroyBuffer);
+            GraphicsBase::getBase().getMemoryAllocator().free(allocation);
+        }
+
+        defineHandleTypeOperator;
+        defineAddressFunction;
+
+        // Const Function
+        const MemoryAllocator::Allocation& getAllocation() const { return allocation; }
+        // Null unless the memory is host-visible.
+        void* pMappedData() const { return allocation.pMappedData; }
+
+        // Non-const Function
+        result_t create(VkBufferCreateInfo& createInfo, VkMemoryPropertyFlags memoryProperties) {
+            createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+            VkDevice device = GraphicsBase::getBase().getDevice();
+            if (VkResult result = vkCreateBuffer(device, &createInfo, HostAllocator::pCallbacks, &handle)) {
+                outStream << std::format("Failed to create a buffer!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            VkBufferMemoryRequirementsInfo2 requirementsInfo = {
+                .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2,
+                .buffer = handle
+            };
+            VkMemoryDedicatedRequirements dedicatedRequirements = { VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+            VkMemoryRequirements2 memoryRequirements = { VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2, &dedicatedRequirements };
+            vkGetBufferMemoryRequirements2(device, &requirementsInfo, &memoryRequirements);
+            MemoryAllocator& memoryAllocator = GraphicsBase::getBase().getMemoryAllocator();
+            if (result_t result = dedicatedRequirements.prefersDedicatedAllocation ?
+                memoryAllocator.allocateDedicated(memoryRequirements.memoryRequirements, memoryProperties, allocation, handle) :
+                memoryAllocator.allocate(memoryRequirements.memoryRequirements, memoryProperties, true, allocation))
+                return result;
+            VkResult result = vkBindBufferMemory(device, handle, allocation.memory, allocation.offset);
+            if (result)
+                outStream << std::format("Failed to bind memory to a buffer!\nError code: {}", int32_t(result)) << std::endl;
+            return result;
+        }
+        result_t create(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memoryProperties) {
+            VkBufferCreateInfo createInfo = {
+                .size = size,
+                .usage = usage,
+                .sharingMode = VK_SHARING_MODE_EXCLUSIVE
+            };
+            return create(createInfo, memoryProperties);
+        }
+    };
+    class Image {
+        VkImage handle = VK_NULL_HANDLE;
+        MemoryAllocator::Allocation allocation;
+    public:
+        Image() = default;
+        Image(VkImageCreateInfo& createInfo, VkMemoryPropertyFlags memoryProperties) {
+            create(createInfo, memoryProperties);
+        }
+        Image(Image&& other) noexcept {
+            moveHandle;
+            allocation = other.allocation;
+            other.allocation = {};
+        }
+        ~Image() {
+            destroyHandleBy(vkDestroyImage);
+            GraphicsBase::getBase().getMemoryAllocator().free(allocation);
+        }
+
+        defineHandleTypeOperator;
+        defineAddressFunction;
+
+        // Const Function
+        const MemoryAllocator::Allocation& getAllocation() const { return allocation; }
+
+        // Non-const Function
+        result_t create(VkImageCreateInfo& createInfo, VkMemoryPropertyFlags memoryProperties) {
+            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+            VkDevice device = GraphicsBase::getBase().getDevice();
+            if (VkResult result = vkCreateImage(device, &createInfo, HostAllocator::pCallbacks, &handle)) {
+                outStream << std::format("Failed to create an image!\nError code: {}", int32_t(result)) << std::endl;
+                return result;
+            }
+            VkImageMemoryRequirementsInfo2 requirementsInfo = {
+                .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_REQUIREMENTS_INFO_2,
+                .image = handle
+            };
+            VkMemoryDedicatedRequirements dedicatedRequirements = { VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS };
+            VkMemoryRequirements2 memoryRequirements = { VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2, &dedicatedRequirements };
+            vkGetImageMemoryRequirements2(device, &requirementsInfo, &memoryRequirements);
+            MemoryAllocator& memoryAllocator = GraphicsBase::getBase().getMemoryAllocator();
+            if (result_t result = dedicatedRequirements.prefersDedicatedAllocation ?
+                memoryAllocator.allocateDedicated(memoryRequirements.memoryRequirements, memoryProperties, allocation, VK_NULL_HANDLE, handle) :
+                memoryAllocator.allocate(memoryRequirements.memoryRequirements, memoryProperties, createInfo.tiling == VK_IMAGE_TILING_LINEAR, allocation))
+                return result;
+            VkResult result = vkBindImageMemory(device, handle, allocation.memory, allocation.offset);
+            if (result)
+                outStream << std::format("Failed to bind memory to an image!\nError code: {}", int32_t(result)) << std::endl;
+            return result;
+        }
+    };
+    class ImageView {
+        VkImageView handle = VK_NULL_HANDLE;
+    public:
+        ImageView() = default;
+        ImageView(VkImageViewCreateInfo& createInfo) {
+            create(createInfo);
+        }
+        ImageView(VkImage image, VkImageViewType viewType, VkFormat format, const VkImageSubresourceRange& subresourceRange, VkImageViewCreateFlags flags = 0) {
+            create(image, viewType, format, subresourceRange, flags);
+        }
+        ImageView(ImageView&& other) noexcept { moveHandle; }
+        ~ImageView() { destroyHandleBy(vkDestroyImageView); }
+
+        defineHandleTypeOperator;
+        defineAddressFunction;
+
+        // Non-const Function
+        result_t create(VkImageViewCreateInfo& createInfo) {
+            createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            VkResult result = vkCreateImageView(GraphicsBase::getBase().getDevice(), &createInfo, HostAllocator::pCallbacks, &handle);
+            if (result)
+                outStream << std::format("Failed to create an image view!\nError code: {}", int32_t(result)) << std::endl;
+            return result;
+        }
+        result_t create(VkImage image, VkImageViewType viewType, VkFormat format, const VkImageSubresourceRange& subresourceRange, VkImageViewCreateFlags flags = 0) {
+            VkImageViewCreateInfo createInfo = {
+                .flags = flags,
+                .image = image,
+                .viewType = viewType,
+                .format = format,
+                .subresourceRange = subresourceRange
+            };
+            return create(createInfo);
+        }
+    };
     class Framebuffer {
         VkFramebuffer handle = VK_NULL_HANDLE;
     public:
@@ -1153,13 +3152,91 @@ namespace Vulkan {
         
         result_t create(VkFramebufferCreateInfo& createInfo) {
             createInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-            VkResult result = vkCreateFramebuffer(GraphicsBase::getBase().getDevice(), &createInfo, nullptr, &handle);
+            VkResult result = vkCreateFramebuffer(GraphicsBase::getBase().getDevice(), &createInfo, HostAllocator::pCallbacks, &handle);
             if (result)
                 outStream << std::format("Failed to create a framebuffer!\nError code: {}", int32_t(result)) << std::endl;
             return result;
         }
     };
 
+    // Results of a VK_QUERY_TYPE_PIPELINE_STATISTICS query created with PipelineStatistics::flags, in the order of the bits.
+    struct PipelineStatistics {
+        static constexpr VkQueryPipelineStatisticFlags flags =
+            VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+        static constexpr uint32_t count = 5;
+        uint64_t vertexShaderInvocations;
+        uint64_t clippingInvocations;
+        uint64_t clippingPrimitives;
+        uint64_t fragmentShaderInvocations;
+        uint64_t computeShaderInvocations;
+
+        PipelineStatistics& operator+=(const PipelineStatistics& other) {
+            vertexShaderInvocations += other.vertexShaderInvocations;
+            clippingInvocations += other.clippingInvocations;
+            clippingPrimitives += other.clippingPrimitives;
+            fragmentShaderInvocations += other.fragmentShaderInvocations;
+            computeShaderInvocations += other.computeShaderInvocations;
+            return *this;
+        }
+    };
+
+    class QueryPool {
+        VkQueryPool handle = VK_NULL_HANDLE;
+    public:
+        QueryPool() = default;
+        QueryPool(VkQueryPoolCreateInfo& createInfo) { create(createInfo); }
+        QueryPool(VkQueryType queryType, uint32_t queryCount, VkQueryPipelineStatisticFlags pipelineStatistics = 0) {
+            create(queryType, queryCount, pipelineStatistics);
+        }
+        QueryPool(QueryPool&& other) noexcept { moveHandle; }
+        ~QueryPool() { destroyHandleBy(vkDestroyQueryPool); }
+
+        defineHandleTypeOperator;
+        defineAddressFunction;
+
+        // Const Function
+        void cmdReset(VkCommandBuffer commandBuffer, uint32_t firstQuery, uint32_t queryCount) const {
+            vkCmdResetQueryPool(commandBuffer, handle, firstQuery, queryCount);
+        }
+        void cmdBegin(VkCommandBuffer commandBuffer, uint32_t queryIndex, VkQueryControlFlags flags = 0) const {
+            vkCmdBeginQuery(commandBuffer, handle, queryIndex, flags);
+        }
+        void cmdEnd(VkCommandBuffer commandBuffer, uint32_t queryIndex) const {
+            vkCmdEndQuery(commandBuffer, handle, queryIndex);
+        }
+        void cmdWriteTimestamp(VkCommandBuffer commandBuffer, VkPipelineStageFlagBits pipelineStage, uint32_t queryIndex) const {
+            vkCmdWriteTimestamp(commandBuffer, pipelineStage, handle, queryIndex);
+        }
+        // Returns VK_NOT_READY without complaint if some results are not available and flags doesn't ask to wait.
+        result_t getResults(uint32_t firstQuery, uint32_t queryCount, size_t dataSize, void* pData, VkDeviceSize stride, VkQueryResultFlags flags = 0) const {
+            VkResult result = vkGetQueryPoolResults(GraphicsBase::getBase().getDevice(), handle, firstQuery, queryCount, dataSize, pData, stride, flags);
+            if (result && result != VK_NOT_READY)
+                outStream << std::format("Failed to get query pool results!\nError code: {}", int32_t(result)) << std::endl;
+            return result;
+        }
+
+        // Non-const Function
+        result_t create(VkQueryPoolCreateInfo& createInfo) {
+            createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+            VkResult result = vkCreateQueryPool(GraphicsBase::getBase().getDevice(), &createInfo, HostAllocator::pCallbacks, &handle);
+            if (result)
+                outStream << std::format("Failed to create a query pool!\nError code: {}", int32_t(result)) << std::endl;
+            return result;
+        }
+        result_t create(VkQueryType queryType, uint32_t queryCount, VkQueryPipelineStatisticFlags pipelineStatistics = 0) {
+            VkQueryPoolCreateInfo createInfo = {
+                .queryType = queryType,
+                .queryCount = queryCount,
+                .pipelineStatistics = pipelineStatistics
+            };
+            return create(createInfo);
+        }
+    };
+
     class PipelineLayout {
         VkPipelineLayout handle = VK_NULL_HANDLE;
     public:
@@ -1175,7 +3252,7 @@ namespace Vulkan {
         
         result_t create(VkPipelineLayoutCreateInfo& createInfo) {
             createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-            VkResult result = vkCreatePipelineLayout(GraphicsBase::getBase().getDevice(), &createInfo, nullptr, &handle);
+            VkResult result = vkCreatePipelineLayout(GraphicsBase::getBase().getDevice(), &createInfo, HostAllocator::pCallbacks, &handle);
             if (result)
                 outStream << std::format("Failed to create a pipeline layout!\nError code: {}", int32_t(result)) << std::endl;
             return result;
@@ -1247,9 +3324,22 @@ namespace Vulkan {
             scissors = other.scissors;
             colorBlendAttachmentStates = other.colorBlendAttachmentStates;
             dynamicStates = other.dynamicStates;
+            dynamicViewportCount = other.dynamicViewportCount;
+            dynamicScissorCount = other.dynamicScissorCount;
             updateAllArrayAddresses();
         }
         operator VkGraphicsPipelineCreateInfo& () { return createInfo; }
+        // Makes viewports and scissors dynamic state, so that the pipeline doesn't depend on the framebuffer size and
+        // survives swapchain recreation. Call before updateAllArrays(), then set them with
+        // CommandBuffer::setViewportAndScissor() after binding the pipeline.
+        void useDynamicViewportAndScissor(uint32_t count = 1) {
+            viewports.clear();
+            scissors.clear();
+            dynamicViewportCount = dynamicScissorCount = count;
+            for (VkDynamicState i : { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR })
+                if (std::find(dynamicStates.begin(), dynamicStates.end(), i) == dynamicStates.end())
+                    dynamicStates.push_back(i);
+        }
         void updateAllArrays() {
             createInfo.stageCount = shaderStages.size();
             vertexInputStateCi.vertexBindingDescriptionCount = vertexInputBindings.size();
@@ -1285,6 +3375,78 @@ namespace Vulkan {
     
     class Pipeline {
         VkPipeline handle = VK_NULL_HANDLE;
+
+        // Batches write to as many pipelines as there are create infos, each of which must not hold a pipeline yet.
+        static VkResult checkBatch(size_t createInfoCount, std::span<const Pipeline> pipelines) {
+            if (pipelines.size() < createInfoCount) {
+                outStream << std::format("Failed to create {} pipelines into {} Pipeline objects!", createInfoCount, pipelines.size()) << std::endl;
+                return VK_ERROR_INITIALIZATION_FAILED;
+            }
+            for (size_t i = 0; i < createInfoCount; i++)
+                if (pipelines[i].handle) {
+                    outStream << std::format("Failed to create pipeline {} of a batch, the Pipeline object already holds one!", i) << std::endl;
+                    return VK_ERROR_INITIALIZATION_FAILED;
+                }
+            return VK_SUCCESS;
+        }
+        template<typename CreateInfo>
+        static VkResult createBatch(std::span<const CreateInfo> createInfos, std::span<Pipeline> pipelines) {
+            constexpr bool graphics = std::same_as<CreateInfo, VkGraphicsPipelineCreateInfo>;
+            if (VkResult result = checkBatch(createInfos.size(), pipelines))
+                return result;
+            std::vector<VkPipeline> handles(createInfos.size());
+            VkResult result;
+            if constexpr (graphics)
+                result = vkCreateGraphicsPipelines(GraphicsBase::getBase().getDevice(), GraphicsBase::getBase().getPipelineCache(),
+                    uint32_t(createInfos.size()), createInfos.data(), HostAllocator::pCallbacks, handles.data());
+            else
+                result = vkCreateComputePipelines(GraphicsBase::getBase().getDevice(), GraphicsBase::getBase().getPipelineCache(),
+                    uint32_t(createInfos.size()), createInfos.data(), HostAllocator::pCallbacks, handles.data());
+            for (size_t i = 0; i < handles.size(); i++)
+                pipelines[i].handle = handles[i];
+            if (result)
+                outStream << std::format("Failed to create {} {} pipelines!\nError code: {}",
+                    createInfos.size(), graphics ? "graphics" : "compute", int32_t(result)) << std::endl;
+            return result;
+        }
+        // Each share is a job of the worker pool of GraphicsBase. The shares do not wait on each other, the last one
+        // to finish sets the result, which is the error of a failed share if any.
+        template<typename CreateInfo>
+        static std::future<VkResult> createAsyncInternal(std::vector<CreateInfo> createInfos, std::span<Pipeline> pipelines, uint32_t threadCount) {
+            struct Batch {
+                std::vector<CreateInfo> createInfos;
+                std::promise<VkResult> promise;
+                std::atomic<uint32_t> shareCountLeft;
+                std::atomic<VkResult> result = VK_SUCCESS;
+            };
+            auto batch = std::make_shared<Batch>();
+            std::future<VkResult> future = batch->promise.get_future();
+            if (VkResult result = checkBatch(createInfos.size(), pipelines)) {
+                batch->promise.set_value(result);
+                return future;
+            }
+            if (!threadCount)
+                threadCount = WorkerPool::getThreadCount();
+            threadCount = uint32_t(std::min<size_t>(threadCount, createInfos.size()));
+            if (!threadCount) {
+                batch->promise.set_value(VK_SUCCESS);
+                return future;
+            }
+            batch->createInfos = std::move(createInfos);
+            batch->shareCountLeft = threadCount;
+            for (uint32_t i = 0; i < threadCount; i++)
+                GraphicsBase::getBase().getWorkerPool().push([batch, pipelines, threadCount, i] {
+                    size_t begin = batch->createInfos.size() * i / threadCount;
+                    size_t end = batch->createInfos.size() * (i + 1) / threadCount;
+                    if (VkResult result = createBatch<CreateInfo>(std::span(batch->createInfos).subspan(begin, end - begin), pipelines.subspan(begin, end - begin))) {
+                        VkResult expected = VK_SUCCESS;
+                        batch->result.compare_exchange_strong(expected, result);
+                    }
+                    if (!--batch->shareCountLeft)
+                        batch->promise.set_value(batch->result);
+                });
+            return future;
+        }
     public:
         Pipeline() = default;
         Pipeline(VkGraphicsPipelineCreateInfo& createInfo) {
@@ -1301,22 +3463,63 @@ namespace Vulkan {
         
         result_t create(VkGraphicsPipelineCreateInfo& createInfo) {
             createInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-            VkResult result = vkCreateGraphicsPipelines(GraphicsBase::getBase().getDevice(), VK_NULL_HANDLE, 1, &createInfo, nullptr, &handle);
+            VkResult result = vkCreateGraphicsPipelines(GraphicsBase::getBase().getDevice(), GraphicsBase::getBase().getPipelineCache(), 1, &createInfo, HostAllocator::pCallbacks, &handle);
             if (result)
                 outStream << std::format("Failed to create a graphics pipeline!\nError code: {}", int32_t(result)) << std::endl;
             return result;
         }
         result_t create(VkComputePipelineCreateInfo& createInfo) {
             createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
-            VkResult result = vkCreateComputePipelines(GraphicsBase::getBase().getDevice(), VK_NULL_HANDLE, 1, &createInfo, nullptr, &handle);
+            VkResult result = vkCreateComputePipelines(GraphicsBase::getBase().getDevice(), GraphicsBase::getBase().getPipelineCache(), 1, &createInfo, HostAllocator::pCallbacks, &handle);
             if (result)
                 outStream << std::format("Failed to create a compute pipeline!\nError code: {}", int32_t(result)) << std::endl;
             return result;
         }
+        // Batched: builds all of the pipelines in one call, pipelines must be at least as many as the create infos
+        // and must not hold pipelines yet. On failure, the pipelines that could be built still are, the others stay null.
+        static result_t create(std::span<VkGraphicsPipelineCreateInfo> createInfos, std::span<Pipeline> pipelines) {
+            for (auto& i : createInfos)
+                i.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+            return createBatch<VkGraphicsPipelineCreateInfo>(createInfos, pipelines);
+        }
+        static result_t create(std::span<VkComputePipelineCreateInfo> createInfos, std::span<Pipeline> pipelines) {
+            for (auto& i : createInfos)
+                i.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            return createBatch<VkComputePipelineCreateInfo>(createInfos, pipelines);
+        }
+        static result_t create(std::span<GraphicsPipelineCreateInfoPack> createInfoPacks, std::span<Pipeline> pipelines) {
+            std::vector<VkGraphicsPipelineCreateInfo> createInfos(createInfoPacks.begin(), createInfoPacks.end());
+            return create(createInfos, pipelines);
+        }
+        // Parallel: splits the pipelines into threadCount shares, by default one per core, each built in one call on the
+        // worker pool of GraphicsBase. The threads share the pipeline cache of GraphicsBase, which the driver synchronizes.
+        // The create infos are copied, but what they point to, and the pipelines, must outlive the returned future.
+        static std::future<VkResult> createAsync(std::span<const VkGraphicsPipelineCreateInfo> createInfos, std::span<Pipeline> pipelines, uint32_t threadCount = 0) {
+            std::vector<VkGraphicsPipelineCreateInfo> copies(createInfos.begin(), createInfos.end());
+            for (auto& i : copies)
+                i.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+            return createAsyncInternal(std::move(copies), pipelines, threadCount);
+        }
+        static std::future<VkResult> createAsync(std::span<const VkComputePipelineCreateInfo> createInfos, std::span<Pipeline> pipelines, uint32_t threadCount = 0) {
+            std::vector<VkComputePipelineCreateInfo> copies(createInfos.begin(), createInfos.end());
+            for (auto& i : copies)
+                i.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+            return createAsyncInternal(std::move(copies), pipelines, threadCount);
+        }
+        static std::future<VkResult> createAsync(std::span<GraphicsPipelineCreateInfoPack> createInfoPacks, std::span<Pipeline> pipelines, uint32_t threadCount = 0) {
+            return createAsyncInternal(std::vector<VkGraphicsPipelineCreateInfo>(createInfoPacks.begin(), createInfoPacks.end()), pipelines, threadCount);
+        }
     };
 
     class ShaderModule {
         VkShaderModule handle = VK_NULL_HANDLE;
+        // Identifiers of SPIR-V, equal exactly when the code is, so that pipelines can be told apart by shader
+        // contents. codes is keyed by the SPIR-V itself and keeps it after the last module with it is destroyed,
+        // so that a module created again from the same code gets the same id, e.g. to find the pipelines built
+        // with the old one. moduleCodes only holds living modules.
+        inline static std::unordered_map<std::string, uint64_t> codes;
+        inline static std::unordered_map<VkShaderModule, uint64_t> moduleCodes;
+        inline static std::mutex mutexCodes;
     public:
         ShaderModule() = default;
         ShaderModule(VkShaderModuleCreateInfo& createInfo) {
@@ -1329,11 +3532,23 @@ namespace Vulkan {
             create(codeSize, pCode);
         }
         ShaderModule(ShaderModule&& other) noexcept { moveHandle; }
-        ~ShaderModule() { destroyHandleBy(vkDestroyShaderModule); }
+        ~ShaderModule() {
+            if (handle) {
+                std::lock_guard lock(mutexCodes);
+                moduleCodes.erase(handle);
+            }
+            destroyHandleBy(vkDestroyShaderModule);
+        }
 
         defineHandleTypeOperator;
         defineAddressFunction;
 
+        // Returns 0 for modules not created by this class, or already destroyed, whose code is unknown.
+        static uint64_t codeIdOf(VkShaderModule shaderModule) {
+            std::lock_guard lock(mutexCodes);
+            auto i = moduleCodes.find(shaderModule);
+            return i == moduleCodes.end() ? 0 : i->second;
+        }
         VkPipelineShaderStageCreateInfo stageCreateInfo(VkShaderStageFlagBits stage, const char* entry = "main") const {
             return {
                 VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,//sType
@@ -1345,26 +3560,38 @@ namespace Vulkan {
                 nullptr                                             //pSpecializationInfo
             };
         }
+        // Needs no device, so it may run on another thread while the instance and the device are being created.
+        // Returns an empty vector on failure.
+        static std::vector<uint32_t> readSpirv(const char* filepath) {
+            std::ifstream file(filepath, std::ios::ate | std::ios::binary);
+            if (!file) {
+                outStream << std::format("Failed to open the file: {}", filepath) << std::endl;
+                return {};
+            }
+            size_t fileSize = size_t(file.tellg());
+            std::vector<uint32_t> binaries(fileSize / 4);
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(binaries.data()), fileSize);
+            return binaries;
+        }
         // Non-const Function
         result_t create(VkShaderModuleCreateInfo& createInfo) {
             createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-            VkResult result = vkCreateShaderModule(GraphicsBase::getBase().getDevice(), &createInfo, nullptr, &handle);
+            VkResult result = vkCreateShaderModule(GraphicsBase::getBase().getDevice(), &createInfo, HostAllocator::pCallbacks, &handle);
             if (result)
                 outStream << std::format("Failed to create a shader module!\nError code: {}", int32_t(result)) << std::endl;
+            else {
+                std::lock_guard lock(mutexCodes);
+                auto i = codes.try_emplace(std::string(reinterpret_cast<const char*>(createInfo.pCode), createInfo.codeSize), codes.size() + 1).first;
+                moduleCodes[handle] = i->second;
+            }
             return result;
         }
         result_t create(const char* filepath /*VkShaderModuleCreateFlags flags*/) {
-            std::ifstream file(filepath, std::ios::ate | std::ios::binary);
-            if (!file) {
-                outStream << std::format("Failed to open the file: {}", filepath) << std::endl;
+            std::vector<uint32_t> binaries = readSpirv(filepath);
+            if (binaries.empty())
                 return VK_RESULT_MAX_ENUM;
-            }
-            size_t fileSize = size_t(file.tellg());
-            std::vector<uint32_t> binaries(fileSize / 4);
-            file.seekg(0);
-            file.read(reinterpret_cast<char*>(binaries.data()), fileSize);
-            file.close();
-            return create(fileSize, binaries.data());
+            return create(binaries.size() * 4, binaries.data());
         }
         result_t create(size_t codeSize, const uint32_t* pCode /*VkShaderModuleCreateFlags flags*/) {
             VkShaderModuleCreateInfo createInfo = {
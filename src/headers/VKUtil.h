@@ -4,8 +4,10 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <deque>
 #include <stack>
 #include <map>
+#include <set>
 #include <unordered_map>
 #include <span>
 #include <memory>
@@ -15,7 +17,15 @@
 #include <chrono>
 #include <numeric>
 #include <numbers>
+#include <bit>
 #include <stdexcept>
+#include <algorithm>
+#include <thread>
+#include <future>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <filesystem>
 
 // GLM
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -75,7 +85,7 @@ using result_t = VkResult;
 #define ENABLE_DEBUG_MESSENGER false
 #endif
 
-#define destroyHandleBy(func) if (handle) { func(GraphicsBase::getBase().getDevice(), handle, nullptr); handle = VK_NULL_HANDLE; }
+#define destroyHandleBy(func) if (handle) { func(GraphicsBase::getBase().getDevice(), handle, HostAllocator::pCallbacks); handle = VK_NULL_HANDLE; }
 #define moveHandle do { handle = other.handle; other.handle = VK_NULL_HANDLE; } while (0)
 #define defineMoveAssignmentOperator(type) type& operator=(type&& other) { this->~type(); moveHandle; return *this; }
 #define defineHandleTypeOperator operator decltype(handle)() const { return handle; }
@@ -83,4 +93,7 @@ using result_t = VkResult;
 
 #define executeOnce(...) { static bool executed = false; if (executed) return __VA_ARGS__; executed = true; }
 
-inline auto& outStream = std::cerr;
\ No newline at end of file
+inline auto& outStream = std::cerr;
+
+// CPU Profiling
+#include "./CpuProfiler.h"
\ No newline at end of file
@@ -1,5 +1,9 @@
 #include "headers/GLFWGeneral.hpp"
 #include "headers/EasyVulkan.hpp"
+#include "headers/FrameGovernor.hpp"
+#include "headers/GpuProfiler.hpp"
+#include "headers/UploadRing.hpp"
+#include "headers/UploadBatcher.hpp"
 
 using namespace Vulkan;
 
@@ -15,105 +19,243 @@ void createLayout() {
     pipelineLayoutTriangle.create(pipelineLayoutCreateInfo);
 }
 
-void createPipeline() {
-    static ShaderModule vert_triangle("triangle.vert.spv");
-    static ShaderModule frag_triangle("triangle.frag.spv");
+// Takes SPIR-V rather than file paths, so that the files can be read while the device is being created.
+void createPipeline(const std::vector<uint32_t>& spirvVert, const std::vector<uint32_t>& spirvFrag) {
+    static ShaderModule vert_triangle(spirvVert.size() * 4, spirvVert.data());
+    static ShaderModule frag_triangle(spirvFrag.size() * 4, spirvFrag.data());
     static VkPipelineShaderStageCreateInfo shaderStageCreateInfosTriangle[2] = {
         vert_triangle.stageCreateInfo(VK_SHADER_STAGE_VERTEX_BIT),
         frag_triangle.stageCreateInfo(VK_SHADER_STAGE_FRAGMENT_BIT)
     };
-    auto create = [] {
-        GraphicsPipelineCreateInfoPack pipelineCiPack;
+    // Viewport and scissor are dynamic, so the pipeline is independent of the window size and survives swapchain recreation.
+    GraphicsPipelineCreateInfoPack pipelineCiPack;
 
-        pipelineCiPack.createInfo.layout = pipelineLayoutTriangle;
-        pipelineCiPack.createInfo.renderPass = renderPassAndFramebuffers().renderPass;
+    pipelineCiPack.createInfo.layout = pipelineLayoutTriangle;
+    pipelineCiPack.createInfo.renderPass = renderPassAndFramebuffers().renderPass;
 
-        pipelineCiPack.inputAssemblyStateCi.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
+    pipelineCiPack.inputAssemblyStateCi.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP;
 
-        pipelineCiPack.viewports.emplace_back(0.f, 0.f, float(windowSize.width), float(windowSize.height), 0.f, 1.f);
-        pipelineCiPack.scissors.emplace_back(VkOffset2D {}, windowSize);
+    pipelineCiPack.useDynamicViewportAndScissor();
 
-        pipelineCiPack.multisampleStateCi.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    pipelineCiPack.multisampleStateCi.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
-        pipelineCiPack.colorBlendAttachmentStates.push_back({ .colorWriteMask = 0b1111 });
+    pipelineCiPack.colorBlendAttachmentStates.push_back({ .colorWriteMask = 0b1111 });
 
-        pipelineCiPack.updateAllArrays();
-        pipelineCiPack.createInfo.stageCount = 2;
-        pipelineCiPack.createInfo.pStages = shaderStageCreateInfosTriangle;
-        
-        pipelineTriangle.create(pipelineCiPack);
-    };
-    auto destroy = [] {
-        pipelineTriangle.~Pipeline();
-    };
-    GraphicsBase::getBase().pushCallbackCreateSwapchain(create);
-    GraphicsBase::getBase().pushCallbackDestroySwapchain(destroy);
-    create();
+    pipelineCiPack.updateAllArrays();
+    pipelineCiPack.createInfo.stageCount = 2;
+    pipelineCiPack.createInfo.pStages = shaderStageCreateInfosTriangle;
+
+    pipelineTriangle.create(pipelineCiPack);
+}
+
+// Writes the last headless frame as a binary PPM.
+bool writeHeadlessFrame(const char* filepath) {
+    const uint8_t* pData = static_cast<const uint8_t*>(
+        GraphicsBase::getBase().getHeadlessReadback(GraphicsBase::getBase().getCurrentImageIndex()));
+    if (!pData)
+        return false;
+    std::ofstream file(filepath, std::ios::binary);
+    if (!file) {
+        outStream << std::format("Failed to open the file: {}", filepath) << std::endl;
+        return false;
+    }
+    VkFormat format = GraphicsBase::getBase().getSwapchainCreateInfo().imageFormat;
+    bool bgr = format == VK_FORMAT_B8G8R8A8_UNORM || format == VK_FORMAT_B8G8R8A8_SRGB;
+    file << std::format("P6\n{} {}\n255\n", windowSize.width, windowSize.height);
+    for (size_t i = 0; i < size_t(windowSize.width) * windowSize.height; i++, pData += 4) {
+        char rgb[3] = { char(pData[bgr ? 2 : 0]), char(pData[1]), char(pData[bgr ? 0 : 2]) };
+        file.write(rgb, 3);
+    }
+    return true;
 }
 
 int main(int argc, char* argv[]) {
 
-    GLFW::initWindow(defaultWindowSize);
+    FrameGovernor frameGovernor;
+    int presentStrategy = -1;
+    const char* telemetryPath = nullptr;
+    bool gpuProfile = false;
+    bool pipelineStatistics = false;
+    const char* cpuTracePath = nullptr;
+    // Headless mode renders this many frames without a window, 0 means windowed.
+    uint32_t headlessFrameCount = 0;
+    const char* headlessOutPath = nullptr;
+    for (int i = 1; i + 1 < argc; i++)
+        if (!strcmp(argv[i], "--frames-in-flight"))
+            GraphicsBase::getBase().setMaxFramesInFlight(uint32_t(std::atoi(argv[++i])));
+        else if (!strcmp(argv[i], "--max-queued-presents"))
+            GraphicsBase::getBase().setMaxQueuedPresents(uint32_t(std::atoi(argv[++i])));
+        else if (!strcmp(argv[i], "--target-fps"))
+            frameGovernor.setTargetFps(std::atof(argv[++i]));
+        else if (!strcmp(argv[i], "--present-strategy"))
+            presentStrategy = std::atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--telemetry-out"))
+            telemetryPath = argv[++i];
+        else if (!strcmp(argv[i], "--gpu-profile"))
+            gpuProfile = std::atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--pipeline-statistics"))
+            pipelineStatistics = std::atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--cpu-trace-out"))
+            cpuTracePath = argv[++i];
+        else if (!strcmp(argv[i], "--headless"))
+            headlessFrameCount = uint32_t(std::atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--headless-out"))
+            headlessOutPath = argv[++i];
+
+    // Disk reads don't depend on Vulkan, so they overlap with the initialization below.
+    auto readSpirv = [](const char* filepath) {
+        return std::async(std::launch::async, [filepath] {
+            GLFW::StartupPhaseTimer phase(filepath);
+            return ShaderModule::readSpirv(filepath);
+        });
+    };
+    std::future<std::vector<uint32_t>> spirvTriangleVert = readSpirv("triangle.vert.spv");
+    std::future<std::vector<uint32_t>> spirvTriangleFrag = readSpirv("triangle.frag.spv");
+    GraphicsBase::getBase().getPipelineCache().load("pipeline_cache.bin");
+
+    if (headlessFrameCount)
+        GLFW::initHeadless(defaultWindowSize, headlessOutPath != nullptr);
+    else
+        GLFW::initWindow(defaultWindowSize);
+    if (presentStrategy >= 0)
+        frameGovernor.setPresentStrategy(FrameGovernor::PresentStrategy(presentStrategy));
 
+    GLFW::StartupPhaseTimer phase("createRenderPass");
     const auto& [renderPass, framebuffers] = renderPassAndFramebuffers();
 
-    createLayout();
-    createPipeline();
+    // Pipelines are built on another thread, while this one creates the per-frame objects.
+    phase.next("createFrameResources");
+    std::future<void> pipelinesCreated = std::async(std::launch::async, [&spirvTriangleVert, &spirvTriangleFrag] {
+        std::vector<uint32_t> spirvVert = spirvTriangleVert.get();
+        std::vector<uint32_t> spirvFrag = spirvTriangleFrag.get();
+        if (spirvVert.empty() || spirvFrag.empty())
+            throw std::runtime_error("Error while reading shaders.");
+        GLFW::StartupPhaseTimer phase("createPipelines");
+        createLayout();
+        createPipeline(spirvVert, spirvFrag);
+    });
 
-    Fence fence(VK_FENCE_CREATE_SIGNALED_BIT);
-    Semaphore semaphoreImageIsAvailable;
-    Semaphore semaphoreRenderingIsOver;
     Semaphore semaphoreOwnershipIsTransfered;
 
-    CommandBuffer commandBufferGraphics;
     // CommandBuffer commandBufferPresentation;
     CommandPool commandPoolGraphics(GraphicsBase::getBase().getQueueFamilyIndexGraphics(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
     // CommandPool commandPoolPresentation(VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT, GraphicsBase::getBase().getQueueFamilyIndexPresentation());
-    commandPoolGraphics.allocateBuffers(commandBufferGraphics);
+    std::vector<EasyVulkan::FrameInFlight> frames = EasyVulkan::createFramesInFlight(commandPoolGraphics);
+    const auto& semaphoresRenderingIsOver = EasyVulkan::createSemaphoresRenderingIsOver();
     // commandPoolPresentation.allocateBuffers(commandBufferPresentation);
 
-    // CommandBuffer commandBuffer;
-    // CommandPool commandPool(GraphicsBase::getBase().getQueueFamilyIndexGraphics(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
-    // commandPool.allocateBuffers(commandBuffer);
+    // Per-frame dynamic data goes here, the triangle keeps its vertices in the shader for now.
+    UploadRing uploadRing(1 << 20);
+    // Static data, e.g. textures and meshes, goes through the transfer queue.
+    UploadBatcher uploadBatcher;
+    uploadBatcher.create();
+    std::vector<GraphicsBase::TimelineWait> timelineWaits;
+
+    GpuProfiler gpuProfiler;
+    if (gpuProfile &&
+        !gpuProfiler.create(32, pipelineStatistics)) {
+        gpuProfiler.setRenderPassName(renderPass, "Screen");
+        gpuProfiler.hookRenderPasses();
+    }
+
+    phase.next("waitPipelines");
+    pipelinesCreated.get();
+    phase.next("firstFrame");
 
     VkClearValue clearColor = { .color = { 0.f, 0.f, 0.f, 1.f } };
 
 
-    while (!GLFW::shouldClose()) {
+    uint32_t frameCount = 0;
+    bool startupReported = false;
+    while (!GLFW::shouldClose() &&
+        (!headlessFrameCount || frameCount++ < headlessFrameCount)) {
 
-        while (glfwGetWindowAttrib(GLFW::pWindow, GLFW_ICONIFIED))
+        while (GLFW::pWindow && glfwGetWindowAttrib(GLFW::pWindow, GLFW_ICONIFIED))
             glfwWaitEvents();
 
         GLFW::fps();
 
+        frameGovernor.wait();
+        GraphicsBase::getBase().paceFrame();
+        GLFW::frameTelemetry.mark(FrameTelemetry::phaseWait);
+
+        auto& [timelineValue, semaphoreImageIsAvailable, commandBufferGraphics] =
+            frames[GraphicsBase::getBase().getCurrentFrameIndex()];
+
+        // Only this slot's previous submission has to be finished, the other slots keep the GPU busy.
+        GraphicsBase::getBase().waitTimeline(GraphicsBase::timelineGraphics, timelineValue);
+        GLFW::frameTelemetry.mark(FrameTelemetry::phaseWait);
+        uploadRing.beginFrame();
+
         GraphicsBase::getBase().swapImage(semaphoreImageIsAvailable);
         
         auto i = GraphicsBase::getBase().getCurrentImageIndex();
-        
-        fence.waitAndReset();
+        VkSemaphore semaphoreRenderingIsOver = semaphoresRenderingIsOver[i];
+        GLFW::frameTelemetry.mark(FrameTelemetry::phaseAcquire);
+
+        GraphicsBase::getBase().waitForSwapchainImage();
+        GLFW::frameTelemetry.mark(FrameTelemetry::phaseWait);
 
-        commandBufferGraphics.begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-        // GraphicsBase::getBase().cmdTransferImageOwnership(commandBufferGraphics);
-        renderPass.cmdBegin(commandBufferGraphics, framebuffers[i], { {}, windowSize }, clearColor);
+        uploadBatcher.submit();
 
-        vkCmdBindPipeline(commandBufferGraphics, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineTriangle);
-        vkCmdDraw(commandBufferGraphics, 3, 1, 0, 0);
+        {
+            cpuZone("Record");
+            commandBufferGraphics.begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+            gpuProfiler.beginFrame(commandBufferGraphics);
+            GLFW::frameTelemetry.setGpuTime(gpuProfiler.getFrameTime());
+            GLFW::frameTelemetry.setGpuStatistics(gpuProfiler.getFrameStatistics());
+            timelineWaits.clear();
+            uploadBatcher.cmdAcquire(commandBufferGraphics, timelineWaits);
+            // GraphicsBase::getBase().cmdTransferImageOwnership(commandBufferGraphics);
+            renderPass.cmdBegin(commandBufferGraphics, framebuffers[i], { {}, windowSize }, clearColor);
 
-        renderPass.cmdEnd(commandBufferGraphics);
+            vkCmdBindPipeline(commandBufferGraphics, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineTriangle);
+            commandBufferGraphics.setViewportAndScissor({ {}, windowSize });
+            vkCmdDraw(commandBufferGraphics, 3, 1, 0, 0);
 
-        commandBufferGraphics.end();
-        GraphicsBase::getBase().submitCommandBufferGraphics(commandBufferGraphics, semaphoreImageIsAvailable, semaphoreRenderingIsOver, fence);
+            renderPass.cmdEnd(commandBufferGraphics);
+
+            commandBufferGraphics.end();
+        }
+        uploadRing.flush();
+        GLFW::frameTelemetry.mark(FrameTelemetry::phaseRecord);
+        GraphicsBase::getBase().enqueueSubmit(GraphicsBase::timelineGraphics, commandBufferGraphics, { timelineWaits.data(), timelineWaits.size() },
+            semaphoreImageIsAvailable, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, semaphoreRenderingIsOver, &timelineValue);
+        GraphicsBase::getBase().setSwapchainImageTimelineValue(timelineValue);
 
         // commandBufferPresentation.begin(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
         // GraphicsBase::getBase().cmdTransferImageOwnership(commandBufferPresentation);
         // commandBufferPresentation.end();
-        // GraphicsBase::getBase().submitCommandBufferPresentation(commandBufferPresentation, VK_NULL_HANDLE, semaphoreOwnershipIsTransfered, fence);
+        // GraphicsBase::getBase().submitCommandBufferPresentation(commandBufferPresentation, VK_NULL_HANDLE, semaphoreOwnershipIsTransfered);
 
+        GraphicsBase::getBase().flushSubmits();
+        GLFW::frameTelemetry.mark(FrameTelemetry::phaseSubmit);
         GraphicsBase::getBase().presentImage(semaphoreRenderingIsOver);
+        GLFW::frameTelemetry.mark(FrameTelemetry::phasePresent);
+        GraphicsBase::getBase().advanceFrame();
+
+        // Time to first frame is measured up to the return of the first present.
+        if (!startupReported) {
+            phase.next(nullptr);
+            GLFW::printStartupPhases();
+            startupReported = true;
+        }
 
-        glfwPollEvents();
+        if (GLFW::pWindow)
+            glfwPollEvents();
     }
     
+    if (telemetryPath)
+        GLFW::frameTelemetry.exportToFile(telemetryPath);
+    if (headlessOutPath)
+        writeHeadlessFrame(headlessOutPath);
+#ifdef VK_CPU_PROFILER
+    if (cpuTracePath)
+        CpuProfiler::exportChromeTrace(cpuTracePath);
+#else
+    if (cpuTracePath)
+        outStream << std::format("--cpu-trace-out requires building with VK_CPU_PROFILER defined.") << std::endl;
+#endif
     GLFW::terminateWindow();
 
     return 0;